@@ -0,0 +1,219 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks of the native kernels behind c_generate_permutations(),
+ * c_compare_perm_pccs() and the exact and stochastic c-value engines, over a
+ * matrix of numbers of conditions, NA rates, pairing types and difference
+ * thresholds. Each benchmark runs on a single thread and reports the number
+ * of permutations scored per second.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "engine.h"
+#include "rng.h"
+
+namespace {
+
+// rows of simulated data per benchmark iteration
+const int n_rows{64};
+
+/*
+ * Simulated data of n_rows rows of n_cols values on a 5-point scale, so that
+ * rows contain ties as in typical repeated measures data, with a proportion
+ * na_rate of values missing. Every row keeps at least two values.
+ */
+struct Data {
+  Data(int n_cols, double na_rate) : values(static_cast<std::size_t>(n_rows) * n_cols) {
+    opa::Xoshiro256 rng(20221014, 0);
+    for (int c = 0; c < n_cols; c++)
+      for (int r = 0; r < n_rows; r++) {
+        const bool missing{c >= 2 && rng.bounded(1000) < na_rate * 1000};
+        values[c * n_rows + r] = missing ? NAN : rng.bounded(5) + 1.0;
+      }
+    matrix.n_rows = n_rows;
+    matrix.n_cols = n_cols;
+    for (int c = 0; c < n_cols; c++)
+      matrix.cols.push_back(values.data() + c * n_rows);
+    for (int c = 0; c < n_cols; c++)
+      h.push_back(c + 1.0);
+  }
+
+  std::vector<double> values;
+  opa::DataMatrix matrix;
+  std::vector<double> h;
+};
+
+template <typename Pairing>
+const char* pairing_name() { return Pairing::pairwise ? "pairwise" : "adjacent"; }
+
+// the n! permutations of 1..n, one after another, as c_generate_permutations()
+std::vector<double> permutation_matrix(int n) {
+  std::vector<double> v(n);
+  for (int i = 0; i < n; i++)
+    v[i] = i + 1;
+  const int n_perms{static_cast<int>(opa::factorial(n))};
+  std::vector<double> perms(static_cast<std::size_t>(n) * n_perms);
+  for (int m = 0; m < n_perms; m++) {
+    std::copy(v.begin(), v.end(), perms.begin() + static_cast<std::ptrdiff_t>(m) * n);
+    std::next_permutation(v.begin(), v.end());
+  }
+  return perms;
+}
+
+void BM_GeneratePermutations(benchmark::State& state) {
+  const int n{static_cast<int>(state.range(0))};
+  for (auto _ : state) {
+    std::vector<double> perms(permutation_matrix(n));
+    benchmark::DoNotOptimize(perms.data());
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(opa::factorial(n)));
+}
+
+template <typename Pairing>
+void BM_ComparePermPccs(benchmark::State& state) {
+  const int n{static_cast<int>(state.range(0))};
+  const double diff_threshold{static_cast<double>(state.range(1))};
+  const std::vector<double> perms(permutation_matrix(n));
+  const int n_perms{static_cast<int>(opa::factorial(n))};
+  std::vector<double> h(n);
+  for (int i = 0; i < n; i++)
+    h[i] = i + 1;
+  std::vector<int> h_ord;
+  opa::ordering(h.data(), n, Pairing::pairwise, 0, h_ord);
+  std::vector<double> perm_pccs(n_perms);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(opa::score_permutations<Pairing>(
+      perms.data(), n, n_perms, diff_threshold, h_ord.data(), 50.0, perm_pccs.data()));
+  state.SetItemsProcessed(state.iterations() * n_perms);
+  state.SetLabel(pairing_name<Pairing>());
+}
+
+template <typename Pairing>
+void BM_ExactRows(benchmark::State& state) {
+  const int n_cols{static_cast<int>(state.range(0))};
+  const double na_rate{state.range(1) / 100.0};
+  const double diff_threshold{static_cast<double>(state.range(2))};
+  const Data data(n_cols, na_rate);
+  const opa::ObservedIndex index(data.matrix, nullptr, n_rows);
+  std::vector<int> full_h_ord;
+  opa::ordering(data.h.data(), n_cols, Pairing::pairwise, 0, full_h_ord);
+  opa::RowScratch s(n_cols);
+  std::vector<double> hist(opa::n_pairs(n_cols, true) + 1);
+  double n_perms{0};
+  for (auto _ : state) {
+    // a fresh cache per iteration, as for each call of c_exact_cvals()
+    opa::NullDistributionCache cache(Pairing::pairwise);
+    for (int i = 0; i < n_rows; i++) {
+      const opa::RowCounts counts{opa::exact_row<Pairing>(
+        index, i, data.h.data(), full_h_ord, diff_threshold, cache, s, hist.data())};
+      benchmark::DoNotOptimize(counts.n_perms_greater_eq);
+      n_perms += counts.n_perms;
+    }
+  }
+  state.counters["perms_per_second"] =
+    benchmark::Counter(n_perms, benchmark::Counter::kIsRate);
+  state.SetLabel(pairing_name<Pairing>());
+}
+
+// the replicates of a row counted by the scorer chosen for it
+template <typename T>
+struct Replicates {
+  typedef int result_type;
+  T* v;
+  int n;
+  int nreps;
+  opa::Xoshiro256& rng;
+
+  template <typename Scorer>
+  int operator()(const Scorer& scorer) const {
+    const int observed{scorer.correct(v)};
+    int n_greater_eq{0};
+    for (int rep = 0; rep < nreps; rep++) {
+      opa::shuffle(v, n, rng);
+      n_greater_eq += scorer.correct(v) >= observed;
+    }
+    return n_greater_eq;
+  }
+};
+
+template <typename Pairing>
+void BM_StochasticRows(benchmark::State& state) {
+  const int n_cols{static_cast<int>(state.range(0))};
+  const double na_rate{state.range(1) / 100.0};
+  const double diff_threshold{static_cast<double>(state.range(2))};
+  const int nreps{1000};
+  const Data data(n_cols, na_rate);
+  const opa::ObservedIndex index(data.matrix, nullptr, n_rows);
+  std::vector<int> full_h_ord;
+  opa::ordering(data.h.data(), n_cols, Pairing::pairwise, 0, full_h_ord);
+  opa::RowScratch s(n_cols);
+  for (auto _ : state) {
+    // each row is shuffled in place from its own stream, as in
+    // c_stochastic_cvals(), scored as ranks with no difference threshold
+    for (int i = 0; i < n_rows; i++) {
+      const int n{index.gather(i, data.h.data(), s.values.data(), s.hs.data())};
+      const std::vector<int>& h_ord =
+        opa::row_ordering<Pairing>(index, i, n, full_h_ord, s);
+      opa::Xoshiro256 rng(1, static_cast<std::uint64_t>(i + 1));
+      int n_greater_eq;
+      if (diff_threshold == 0) {
+        opa::encode_ranks(s.values.data(), n, s.ranks.data(), s.sorted);
+        n_greater_eq = opa::with_rank_scorer<Pairing>(
+          h_ord.data(), n, s.h_signs, Replicates<std::int32_t>{s.ranks.data(), n, nreps, rng});
+      } else {
+        n_greater_eq = opa::with_permutation_scorer<Pairing>(
+          h_ord.data(), n, diff_threshold, s.h_bits,
+          Replicates<double>{s.values.data(), n, nreps, rng});
+      }
+      benchmark::DoNotOptimize(n_greater_eq);
+    }
+  }
+  state.counters["perms_per_second"] = benchmark::Counter(
+    static_cast<double>(state.iterations()) * n_rows * nreps, benchmark::Counter::kIsRate);
+  state.SetLabel(pairing_name<Pairing>());
+}
+
+// conditions x NA rate (%) x difference threshold
+void row_matrix(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"conditions", "na_pct", "threshold"});
+  for (int n_cols : {3, 5, 8})
+    for (int na_pct : {0, 10})
+      for (int threshold : {0, 1})
+        b->Args({n_cols, na_pct, threshold});
+}
+
+} // namespace
+
+BENCHMARK(BM_GeneratePermutations)->ArgName("conditions")->DenseRange(3, 9, 2);
+BENCHMARK_TEMPLATE(BM_ComparePermPccs, opa::Pairwise)
+  ->ArgNames({"conditions", "threshold"})->ArgsProduct({{3, 5, 7, 9}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_ComparePermPccs, opa::Adjacent)
+  ->ArgNames({"conditions", "threshold"})->ArgsProduct({{3, 5, 7, 9}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_ExactRows, opa::Pairwise)->Apply(row_matrix)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_ExactRows, opa::Adjacent)->Apply(row_matrix)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_StochasticRows, opa::Pairwise)->Apply(row_matrix)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_StochasticRows, opa::Adjacent)->Apply(row_matrix)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
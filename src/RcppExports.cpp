@@ -10,14 +10,34 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// c_compare_conditions
+List c_compare_conditions(SEXP dat, NumericVector h, double diff_threshold, String cval_method, int nreps, NumericMatrix seeds, IntegerVector pairs, int nthreads, bool progress);
+RcppExport SEXP _opa_c_compare_conditions(SEXP datSEXP, SEXP hSEXP, SEXP diff_thresholdSEXP, SEXP cval_methodSEXP, SEXP nrepsSEXP, SEXP seedsSEXP, SEXP pairsSEXP, SEXP nthreadsSEXP, SEXP progressSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type h(hSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
+    Rcpp::traits::input_parameter< String >::type cval_method(cval_methodSEXP);
+    Rcpp::traits::input_parameter< int >::type nreps(nrepsSEXP);
+    Rcpp::traits::input_parameter< NumericMatrix >::type seeds(seedsSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type pairs(pairsSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type progress(progressSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_compare_conditions(dat, h, diff_threshold, cval_method, nreps, seeds, pairs, nthreads, progress));
+    return rcpp_result_gen;
+END_RCPP
+}
+
 // c_sign_with_threshold
-IntegerVector c_sign_with_threshold(NumericVector xs, float diff_threshold);
+IntegerVector c_sign_with_threshold(NumericVector xs, double diff_threshold);
 RcppExport SEXP _opa_c_sign_with_threshold(SEXP xsSEXP, SEXP diff_thresholdSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< NumericVector >::type xs(xsSEXP);
-    Rcpp::traits::input_parameter< float >::type diff_threshold(diff_thresholdSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
     rcpp_result_gen = Rcpp::wrap(c_sign_with_threshold(xs, diff_threshold));
     return rcpp_result_gen;
 END_RCPP
@@ -46,18 +66,43 @@ BEGIN_RCPP
 END_RCPP
 }
 // c_ordering
-IntegerVector c_ordering(NumericVector xs, String pairing_type, float diff_threshold);
+IntegerVector c_ordering(NumericVector xs, String pairing_type, double diff_threshold);
 RcppExport SEXP _opa_c_ordering(SEXP xsSEXP, SEXP pairing_typeSEXP, SEXP diff_thresholdSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< NumericVector >::type xs(xsSEXP);
     Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
-    Rcpp::traits::input_parameter< float >::type diff_threshold(diff_thresholdSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
     rcpp_result_gen = Rcpp::wrap(c_ordering(xs, pairing_type, diff_threshold));
     return rcpp_result_gen;
 END_RCPP
 }
+// c_diffs_matrix
+NumericMatrix c_diffs_matrix(SEXP dat, String pairing_type);
+RcppExport SEXP _opa_c_diffs_matrix(SEXP datSEXP, SEXP pairing_typeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_diffs_matrix(dat, pairing_type));
+    return rcpp_result_gen;
+END_RCPP
+}
+// c_ordering_matrix
+IntegerMatrix c_ordering_matrix(SEXP dat, String pairing_type, double diff_threshold);
+RcppExport SEXP _opa_c_ordering_matrix(SEXP datSEXP, SEXP pairing_typeSEXP, SEXP diff_thresholdSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_ordering_matrix(dat, pairing_type, diff_threshold));
+    return rcpp_result_gen;
+END_RCPP
+}
 // c_compare_perm_pccs
 List c_compare_perm_pccs(NumericMatrix perms, List m, int indiv_idx, IntegerVector H_ord);
 RcppExport SEXP _opa_c_compare_perm_pccs(SEXP permsSEXP, SEXP mSEXP, SEXP indiv_idxSEXP, SEXP H_ordSEXP) {
@@ -83,3 +128,178 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// c_pcc_matrix
+List c_pcc_matrix(SEXP dat, NumericVector h, String pairing_type, double diff_threshold);
+RcppExport SEXP _opa_c_pcc_matrix(SEXP datSEXP, SEXP hSEXP, SEXP pairing_typeSEXP, SEXP diff_thresholdSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type h(hSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_pcc_matrix(dat, h, pairing_type, diff_threshold));
+    return rcpp_result_gen;
+END_RCPP
+}
+// c_pcc_threshold_sweep
+List c_pcc_threshold_sweep(SEXP dat, NumericVector h, String pairing_type, NumericVector thresholds, int nthreads);
+RcppExport SEXP _opa_c_pcc_threshold_sweep(SEXP datSEXP, SEXP hSEXP, SEXP pairing_typeSEXP, SEXP thresholdsSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type h(hSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type thresholds(thresholdsSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_pcc_threshold_sweep(dat, h, pairing_type, thresholds, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// c_exact_perm_counts
+List c_exact_perm_counts(NumericVector v, IntegerVector H_ord, String pairing_type, double diff_threshold, bool histogram);
+RcppExport SEXP _opa_c_exact_perm_counts(SEXP vSEXP, SEXP H_ordSEXP, SEXP pairing_typeSEXP, SEXP diff_thresholdSEXP, SEXP histogramSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type v(vSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type H_ord(H_ordSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
+    Rcpp::traits::input_parameter< bool >::type histogram(histogramSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_exact_perm_counts(v, H_ord, pairing_type, diff_threshold, histogram));
+    return rcpp_result_gen;
+END_RCPP
+}
+// c_null_distribution
+NumericVector c_null_distribution(NumericVector h, String pairing_type);
+RcppExport SEXP _opa_c_null_distribution(SEXP hSEXP, SEXP pairing_typeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type h(hSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_null_distribution(h, pairing_type));
+    return rcpp_result_gen;
+END_RCPP
+}
+// c_exact_cvals
+List c_exact_cvals(SEXP dat, NumericVector h, String pairing_type, double diff_threshold, bool histogram, IntegerVector rows, int nthreads, bool progress);
+RcppExport SEXP _opa_c_exact_cvals(SEXP datSEXP, SEXP hSEXP, SEXP pairing_typeSEXP, SEXP diff_thresholdSEXP, SEXP histogramSEXP, SEXP rowsSEXP, SEXP nthreadsSEXP, SEXP progressSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type h(hSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
+    Rcpp::traits::input_parameter< bool >::type histogram(histogramSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type rows(rowsSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type progress(progressSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_exact_cvals(dat, h, pairing_type, diff_threshold, histogram, rows, nthreads, progress));
+    return rcpp_result_gen;
+END_RCPP
+}
+// c_exact_row_perms
+NumericVector c_exact_row_perms(SEXP dat, NumericVector h, double diff_threshold, IntegerVector rows);
+RcppExport SEXP _opa_c_exact_row_perms(SEXP datSEXP, SEXP hSEXP, SEXP diff_thresholdSEXP, SEXP rowsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type h(hSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type rows(rowsSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_exact_row_perms(dat, h, diff_threshold, rows));
+    return rcpp_result_gen;
+END_RCPP
+}
+// c_exact_range_cvals
+List c_exact_range_cvals(SEXP dat, NumericVector h, String pairing_type, double diff_threshold, bool histogram, int row, double first, double last, int nthreads, bool progress);
+RcppExport SEXP _opa_c_exact_range_cvals(SEXP datSEXP, SEXP hSEXP, SEXP pairing_typeSEXP, SEXP diff_thresholdSEXP, SEXP histogramSEXP, SEXP rowSEXP, SEXP firstSEXP, SEXP lastSEXP, SEXP nthreadsSEXP, SEXP progressSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type h(hSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
+    Rcpp::traits::input_parameter< bool >::type histogram(histogramSEXP);
+    Rcpp::traits::input_parameter< int >::type row(rowSEXP);
+    Rcpp::traits::input_parameter< double >::type first(firstSEXP);
+    Rcpp::traits::input_parameter< double >::type last(lastSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type progress(progressSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_exact_range_cvals(dat, h, pairing_type, diff_threshold, histogram, row, first, last, nthreads, progress));
+    return rcpp_result_gen;
+END_RCPP
+}
+// c_stochastic_cvals
+List c_stochastic_cvals(SEXP dat, NumericVector h, String pairing_type, double diff_threshold, int nreps, NumericVector seed, String replicates, IntegerVector rows, int stream_offset, int nthreads, bool progress);
+RcppExport SEXP _opa_c_stochastic_cvals(SEXP datSEXP, SEXP hSEXP, SEXP pairing_typeSEXP, SEXP diff_thresholdSEXP, SEXP nrepsSEXP, SEXP seedSEXP, SEXP replicatesSEXP, SEXP rowsSEXP, SEXP stream_offsetSEXP, SEXP nthreadsSEXP, SEXP progressSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type h(hSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
+    Rcpp::traits::input_parameter< int >::type nreps(nrepsSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< String >::type replicates(replicatesSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type rows(rowsSEXP);
+    Rcpp::traits::input_parameter< int >::type stream_offset(stream_offsetSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type progress(progressSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_stochastic_cvals(dat, h, pairing_type, diff_threshold, nreps, seed, replicates, rows, stream_offset, nthreads, progress));
+    return rcpp_result_gen;
+END_RCPP
+}
+// c_adaptive_cvals
+List c_adaptive_cvals(SEXP dat, NumericVector h, String pairing_type, double diff_threshold, int max_reps, NumericVector seed, double cval_threshold, double cval_precision, int batch, double confidence, String replicates, IntegerVector rows, int stream_offset, int nthreads, bool progress);
+RcppExport SEXP _opa_c_adaptive_cvals(SEXP datSEXP, SEXP hSEXP, SEXP pairing_typeSEXP, SEXP diff_thresholdSEXP, SEXP max_repsSEXP, SEXP seedSEXP, SEXP cval_thresholdSEXP, SEXP cval_precisionSEXP, SEXP batchSEXP, SEXP confidenceSEXP, SEXP replicatesSEXP, SEXP rowsSEXP, SEXP stream_offsetSEXP, SEXP nthreadsSEXP, SEXP progressSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type h(hSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
+    Rcpp::traits::input_parameter< int >::type max_reps(max_repsSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< double >::type cval_threshold(cval_thresholdSEXP);
+    Rcpp::traits::input_parameter< double >::type cval_precision(cval_precisionSEXP);
+    Rcpp::traits::input_parameter< int >::type batch(batchSEXP);
+    Rcpp::traits::input_parameter< double >::type confidence(confidenceSEXP);
+    Rcpp::traits::input_parameter< String >::type replicates(replicatesSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type rows(rowsSEXP);
+    Rcpp::traits::input_parameter< int >::type stream_offset(stream_offsetSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type progress(progressSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_adaptive_cvals(dat, h, pairing_type, diff_threshold, max_reps, seed, cval_threshold, cval_precision, batch, confidence, replicates, rows, stream_offset, nthreads, progress));
+    return rcpp_result_gen;
+END_RCPP
+}
+// c_multi_cvals
+List c_multi_cvals(SEXP dat, NumericMatrix hypotheses, String pairing_type, double diff_threshold, String cval_method, int nreps, NumericVector seed, IntegerVector rows, bool histogram, int nthreads, bool progress);
+RcppExport SEXP _opa_c_multi_cvals(SEXP datSEXP, SEXP hypothesesSEXP, SEXP pairing_typeSEXP, SEXP diff_thresholdSEXP, SEXP cval_methodSEXP, SEXP nrepsSEXP, SEXP seedSEXP, SEXP rowsSEXP, SEXP histogramSEXP, SEXP nthreadsSEXP, SEXP progressSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type dat(datSEXP);
+    Rcpp::traits::input_parameter< NumericMatrix >::type hypotheses(hypothesesSEXP);
+    Rcpp::traits::input_parameter< String >::type pairing_type(pairing_typeSEXP);
+    Rcpp::traits::input_parameter< double >::type diff_threshold(diff_thresholdSEXP);
+    Rcpp::traits::input_parameter< String >::type cval_method(cval_methodSEXP);
+    Rcpp::traits::input_parameter< int >::type nreps(nrepsSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type rows(rowsSEXP);
+    Rcpp::traits::input_parameter< bool >::type histogram(histogramSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type progress(progressSEXP);
+    rcpp_result_gen = Rcpp::wrap(c_multi_cvals(dat, hypotheses, pairing_type, diff_threshold, cval_method, nreps, seed, rows, histogram, nthreads, progress));
+    return rcpp_result_gen;
+END_RCPP
+}
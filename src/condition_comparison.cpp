@@ -0,0 +1,165 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <Rcpp.h>
+#include "data_matrix.h"
+#include "kernels.h"
+#include "r_monitor.h"
+#include "rng.h"
+#include "threads.h"
+
+using namespace Rcpp;
+
+/*
+ * Counts for a single pair of conditions, pooled over the individuals with
+ * values for both.
+ */
+struct PairCounts {
+  double correct_pairs;
+  double total_pairs;
+  double n_perms;
+  double n_perms_greater_eq;
+};
+
+/*
+ * Score the pair of conditions (i, j) of a data matrix. Each
+ * individual with both values contributes a single ordinal relation, and a
+ * row of 2 values has only 2 permutations: as observed and swapped. Swapping
+ * negates the sign of the relation, so whether each permutation classifies
+ * the relation correctly is known without reordering anything. For the
+ * exact method both permutations are counted. For the stochastic method the
+ * shuffles opa() would make of the row are replayed from the same stream,
+ * in which each shuffle swaps the two values if the draw is 0, so the counts
+ * are identical to fitting the pair of columns alone with opa(). Each row of
+ * the data, with or without both values, adds 1 to progress for the exact
+ * method and nreps for the stochastic method, and scoring stops early, with
+ * incomplete counts, if the work is cancelled.
+ */
+static PairCounts compare_pair(const opa::DataMatrix& data, int i, int j, int h_sign,
+                               double diff_threshold, bool exact, int nreps,
+                               std::uint64_t seed, opa::Progress* progress) {
+  PairCounts counts{0, 0, 0, 0};
+  opa::ProgressTicker ticker(progress);
+  const unsigned long long row_work{exact ? 1ULL : static_cast<unsigned long long>(nreps)};
+  const double* xi{data.cols[i]};
+  const double* xj{data.cols[j]};
+  int row{0};
+  for (int r = 0; r < data.n_rows; r++) {
+    if (!ticker.tick(row_work))
+      break;
+    if (std::isnan(xi[r]) || std::isnan(xj[r]))
+      continue;
+    // rows are numbered as in the data with incomplete pairs omitted
+    row++;
+    const int sign{opa::sign_with_threshold(xj[r] - xi[r], diff_threshold)};
+    const bool observed{sign == h_sign};
+    const bool swapped{-sign == h_sign};
+    counts.correct_pairs += observed;
+    counts.total_pairs++;
+    if (exact) {
+      counts.n_perms += 2;
+      counts.n_perms_greater_eq += 1 + (swapped >= observed);
+    } else {
+      opa::Xoshiro256 rng(seed, static_cast<std::uint64_t>(row));
+      bool is_swapped{false};
+      for (int rep = 0; rep < nreps; rep++) {
+        if (rng.bounded(2) == 0)
+          is_swapped = !is_swapped;
+        if ((is_swapped ? swapped : observed) >= observed)
+          counts.n_perms_greater_eq++;
+      }
+      counts.n_perms += nreps;
+    }
+  }
+  return counts;
+}
+
+/*
+ * Calculate PCCs and c-values for pairs of conditions of a data matrix. The
+ * pairs are numbered as opa's compare_conditions() visits them, (1, 2),
+ * (1, 3), ..., (1, n), (2, 3), ..., and the results for pair (i, j) are
+ * stored in element [j, i] of the returned matrices. Each pair is scored
+ * from the individuals with values for both conditions, and the pairs are
+ * processed in parallel using nthreads threads.
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: h, a NumericVector hypothesis with length equal to ncol(dat).
+ * param: diff_threshold, a positive double.
+ * param: cval_method, a String, either "exact" or "stochastic".
+ * param: nreps, the number of random reorderings of each row, ignored if
+ * cval_method is "exact".
+ * param: seeds, a NumericMatrix with 2 rows and 1 column per pair of
+ * conditions, each column a seed of 2 integers in [0, 2^32) drawn in R.
+ * Ignored if cval_method is "exact".
+ * param: pairs, an IntegerVector of the (1-based) pairs to process.
+ * param: nthreads, the number of threads to use.
+ * param: progress, whether to draw a progress bar, counting the rows scored
+ * for every pair, times nreps for the stochastic method. Interrupts are
+ * handled as by c_exact_cvals().
+ * return: a List containing ncol(dat) x ncol(dat) matrices pccs and cvals
+ * which are NA except in the lower triangle elements of the processed pairs.
+ */
+// [[Rcpp::export]]
+List c_compare_conditions(SEXP dat, NumericVector h, double diff_threshold,
+                          String cval_method, int nreps, NumericMatrix seeds,
+                          IntegerVector pairs, int nthreads, bool progress) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const int n_cols{data.n_cols};
+  const bool exact{cval_method == "exact"};
+  std::vector<int> first;
+  std::vector<int> second;
+  for (int i = 0; i + 1 < n_cols; i++) {
+    for (int j = i + 1; j < n_cols; j++) {
+      first.push_back(i);
+      second.push_back(j);
+    }
+  }
+  const int n_pairs{static_cast<int>(pairs.length())};
+
+  std::vector<std::uint64_t> pair_seeds(n_pairs, 0);
+  if (!exact)
+    for (int p = 0; p < n_pairs; p++)
+      pair_seeds[p] = opa::make_seed(seeds(0, pairs[p] - 1), seeds(1, pairs[p] - 1));
+
+  std::vector<PairCounts> counts(n_pairs);
+  const double* hyp{h.begin()};
+  RMonitor monitor(progress);
+  monitor.set_total(static_cast<double>(n_pairs) * data.n_rows * (exact ? 1 : nreps));
+  opa::parallel_for(n_pairs, nthreads, [&](std::size_t p, int) {
+    const int i{first[pairs[p] - 1]};
+    const int j{second[pairs[p] - 1]};
+    counts[p] = compare_pair(data, i, j, opa::sign_with_threshold(hyp[j] - hyp[i], 0),
+                             diff_threshold, exact, nreps, pair_seeds[p], &monitor.progress);
+  }, &monitor);
+  monitor.finish();
+
+  NumericMatrix pccs(n_cols, n_cols);
+  NumericMatrix cvals(n_cols, n_cols);
+  std::fill(pccs.begin(), pccs.end(), NA_REAL);
+  std::fill(cvals.begin(), cvals.end(), NA_REAL);
+  for (int p = 0; p < n_pairs; p++) {
+    const int i{first[pairs[p] - 1]};
+    const int j{second[pairs[p] - 1]};
+    pccs(j, i) = (counts[p].correct_pairs / counts[p].total_pairs) * 100;
+    cvals(j, i) = counts[p].n_perms_greater_eq / counts[p].n_perms;
+  }
+
+  return List::create(_["pccs"] = pccs,
+                      _["cvals"] = cvals);
+}
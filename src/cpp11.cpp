@@ -18,20 +18,46 @@ extern "C" SEXP _opa_fun() {
 
 extern "C" {
 /* .Call calls */
+extern SEXP _opa_c_adaptive_cvals(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _opa_c_all_diffs(SEXP);
+extern SEXP _opa_c_compare_conditions(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _opa_c_compare_perm_pccs(SEXP, SEXP, SEXP, SEXP);
+extern SEXP _opa_c_diffs_matrix(SEXP, SEXP);
+extern SEXP _opa_c_exact_cvals(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _opa_c_exact_perm_counts(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _opa_c_exact_range_cvals(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _opa_c_exact_row_perms(SEXP, SEXP, SEXP, SEXP);
 extern SEXP _opa_c_generate_permutations(SEXP);
+extern SEXP _opa_c_multi_cvals(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _opa_c_null_distribution(SEXP, SEXP);
 extern SEXP _opa_c_ordering(SEXP, SEXP, SEXP);
+extern SEXP _opa_c_ordering_matrix(SEXP, SEXP, SEXP);
+extern SEXP _opa_c_pcc_matrix(SEXP, SEXP, SEXP, SEXP);
+extern SEXP _opa_c_pcc_threshold_sweep(SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _opa_c_random_shuffles(SEXP, SEXP);
 extern SEXP _opa_c_sign_with_threshold(SEXP, SEXP);
+extern SEXP _opa_c_stochastic_cvals(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 
 static const R_CallMethodDef CallEntries[] = {
+    {"_opa_c_adaptive_cvals",        (DL_FUNC) &_opa_c_adaptive_cvals,       15},
     {"_opa_c_all_diffs",             (DL_FUNC) &_opa_c_all_diffs,             1},
+    {"_opa_c_compare_conditions",    (DL_FUNC) &_opa_c_compare_conditions,    9},
     {"_opa_c_compare_perm_pccs",     (DL_FUNC) &_opa_c_compare_perm_pccs,     4},
+    {"_opa_c_diffs_matrix",          (DL_FUNC) &_opa_c_diffs_matrix,          2},
+    {"_opa_c_exact_cvals",           (DL_FUNC) &_opa_c_exact_cvals,           8},
+    {"_opa_c_exact_perm_counts",     (DL_FUNC) &_opa_c_exact_perm_counts,     5},
+    {"_opa_c_exact_range_cvals",     (DL_FUNC) &_opa_c_exact_range_cvals,    10},
+    {"_opa_c_exact_row_perms",       (DL_FUNC) &_opa_c_exact_row_perms,       4},
     {"_opa_c_generate_permutations", (DL_FUNC) &_opa_c_generate_permutations, 1},
+    {"_opa_c_multi_cvals",           (DL_FUNC) &_opa_c_multi_cvals,          11},
+    {"_opa_c_null_distribution",     (DL_FUNC) &_opa_c_null_distribution,     2},
     {"_opa_c_ordering",              (DL_FUNC) &_opa_c_ordering,              3},
+    {"_opa_c_ordering_matrix",       (DL_FUNC) &_opa_c_ordering_matrix,       3},
+    {"_opa_c_pcc_matrix",            (DL_FUNC) &_opa_c_pcc_matrix,            4},
+    {"_opa_c_pcc_threshold_sweep",   (DL_FUNC) &_opa_c_pcc_threshold_sweep,   5},
     {"_opa_c_random_shuffles",       (DL_FUNC) &_opa_c_random_shuffles,       2},
     {"_opa_c_sign_with_threshold",   (DL_FUNC) &_opa_c_sign_with_threshold,   2},
+    {"_opa_c_stochastic_cvals",      (DL_FUNC) &_opa_c_stochastic_cvals,     11},
     {"_opa_fun",                     (DL_FUNC) &_opa_fun,                     0},
     {NULL, NULL, 0}
 };
@@ -19,6 +19,12 @@
 
 #include <Rcpp.h>
 #include <cpp11.hpp>
+#include "data_matrix.h"
+#include "engine.h"
+#include "kernels.h"
+#include "null_distribution.h"
+#include "rng.h"
+#include "threads.h"
 
 using namespace Rcpp;
 using namespace cpp11;
@@ -40,7 +46,7 @@ void fun() {}
  * return: an int from the set {1, 0, -1}.
  */
 // [[Rcpp::export]]
-IntegerVector c_sign_with_threshold(NumericVector xs, float diff_threshold) {
+IntegerVector c_sign_with_threshold(NumericVector xs, double diff_threshold) {
   IntegerVector sign_vector(xs.length());
   for (int i = 0; i < xs.length(); i++) {
     if (is_na(xs[i])) {
@@ -88,16 +94,24 @@ NumericVector c_all_diffs(NumericVector xs) {
 }
 
 /*
- * Generate a matrix of randomly shuffled vectors.
+ * Generate a matrix of randomly shuffled vectors. Each column is produced by
+ * shuffling a single reusable buffer in place, using the package's native
+ * random number generator seeded from R's random number generator.
  * param n: an int indicating the number of random reorderings.
  * param v: a NumericVector to be shuffled.
- * return: a NumericMatrix with nrows = n and ncols = v.length().
+ * return: a NumericMatrix with nrows = v.length() and ncols = n.
  */
 // [[Rcpp::export]]
 NumericMatrix c_random_shuffles(int n, NumericVector v) {
-  NumericMatrix rand_orders(v.length(), n);
+  const int len{static_cast<int>(v.length())};
+  NumericMatrix rand_orders(len, n);
+  const double high{std::floor(R::unif_rand() * 4294967296.0)};
+  const double low{std::floor(R::unif_rand() * 4294967296.0)};
+  opa::Xoshiro256 rng(opa::make_seed(high, low), 0);
+  std::vector<double> perm(v.begin(), v.end());
   for (int i = 0; i < n; i++) {
-    rand_orders(_, i) = sample(v, v.length());
+    opa::shuffle(perm.data(), len, rng);
+    std::copy(perm.begin(), perm.end(), rand_orders.begin() + static_cast<R_xlen_t>(i) * len);
   }
   return rand_orders;
 }
@@ -113,13 +127,52 @@ NumericMatrix c_random_shuffles(int n, NumericVector v) {
  * return: an IntegerVector.
 */
 // [[Rcpp::export]]
-IntegerVector c_ordering(NumericVector xs, String pairing_type, float diff_threshold) {
+IntegerVector c_ordering(NumericVector xs, String pairing_type, double diff_threshold) {
   if (pairing_type == "pairwise")
     return(c_sign_with_threshold(c_all_diffs(xs), diff_threshold));
   else
     return c_sign_with_threshold(diff(xs), diff_threshold);
 }
 
+/*
+ * Calculate the difference between the values of every pair of conditions
+ * for every row of a data matrix in a single call. Column p of the result
+ * holds difference p of c_all_diffs() applied to each row when
+ * pairing_type = "pairwise", or of diff() when pairing_type = "adjacent".
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * return: a NumericMatrix with 1 row per individual and 1 column per pair.
+ */
+// [[Rcpp::export]]
+NumericMatrix c_diffs_matrix(SEXP dat, String pairing_type) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const bool pairwise{pairing_type == "pairwise"};
+  NumericMatrix diffs(data.n_rows, opa::n_pairs(data.n_cols, pairwise));
+  opa::diff_columns(data.cols.data(), data.n_cols, data.n_rows, pairwise, diffs.begin());
+  return diffs;
+}
+
+/*
+ * Generate the ordinal relations of every row of a data matrix in a single
+ * call. Row i of the result is c_ordering() applied to row i of the data,
+ * with NA for each relation involving a missing value.
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * param: diff_threshold, a positive double.
+ * return: an IntegerMatrix with 1 row per individual and 1 column per pair.
+ */
+// [[Rcpp::export]]
+IntegerMatrix c_ordering_matrix(SEXP dat, String pairing_type, double diff_threshold) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const bool pairwise{pairing_type == "pairwise"};
+  IntegerMatrix ord(data.n_rows, opa::n_pairs(data.n_cols, pairwise));
+  opa::ordering_columns(data.cols.data(), data.n_cols, data.n_rows, pairwise,
+                        diff_threshold, NA_INTEGER, ord.begin());
+  return ord;
+}
+
 /*
  * Calculate a PCC for each reordered vector and compare it to the corresponding
  * observed PCC from m. Increments n_perms_greater_eq for each reordering with a
@@ -133,28 +186,29 @@ IntegerVector c_ordering(NumericVector xs, String pairing_type, float diff_thres
  */
 // [[Rcpp::export]]
 List c_compare_perm_pccs(NumericMatrix perms, List m, int indiv_idx, IntegerVector H_ord) {
-  int n_perms_greater_eq{0};
   double diff_threshold{m["diff_threshold"]};
   String pairing_type = m["pairing_type"];
   NumericVector obs_pcc = m["individual_pccs"];
   NumericVector perm_pcc(perms.ncol());
-  LogicalVector comps(H_ord.length());
 
-  for (int i = 0; i < perms.ncol(); i++) {
-    NumericVector perm_ordering(H_ord.length());
-    perm_ordering = c_ordering(perms(_,i), pairing_type, diff_threshold);
-    for (int j = 0; j < perm_ordering.length(); j++) {
-      comps[j] = perm_ordering[j] == H_ord[j];
-    }
-    perm_pcc[i] = mean(comps) * 100;
-    if (perm_pcc[i] >= obs_pcc[indiv_idx - 1]) {
-      n_perms_greater_eq += 1;
-    }
-  }
+  // each permutation is scored in place from its column of perms
+  int n_perms_greater_eq;
+  if (pairing_type == "pairwise")
+    n_perms_greater_eq = opa::score_permutations<opa::Pairwise>(
+      perms.begin(), perms.nrow(), perms.ncol(), diff_threshold,
+      H_ord.begin(), obs_pcc[indiv_idx - 1], perm_pcc.begin());
+  else
+    n_perms_greater_eq = opa::score_permutations<opa::Adjacent>(
+      perms.begin(), perms.nrow(), perms.ncol(), diff_threshold,
+      H_ord.begin(), obs_pcc[indiv_idx - 1], perm_pcc.begin());
+
   List out = List::create(Named("n_perms_greater_eq") = n_perms_greater_eq, _["perm_pcc"] = perm_pcc);
   return out;
 }
 
+// the largest n for which n! fits in an int
+const int max_stored_n{12};
+
 /*
  * Generate every permutation of a numeric vector using the next_permutation()
  * function from the C++ standard library.
@@ -162,23 +216,262 @@ List c_compare_perm_pccs(NumericMatrix perms, List m, int indiv_idx, IntegerVect
  * number of columns equal to the factorial of the length of the input vector.
  * The number of permutations is always the factorial of the length of the input
  * vector, even when there are duplicate permutations due to repeated elements
- * of the input vector.
+ * of the input vector: next_permutation() wraps around from the last distinct
+ * permutation to the first, so each distinct permutation appears once for each
+ * rearrangement of its tied values. Exact c-values do not use this matrix but
+ * visit each distinct permutation once, weighted by that number.
+ * Vectors of more than max_stored_n elements have more permutations than a
+ * matrix can hold.
  * param: v, a NumericVector
  * return: a NumericMatrix
  */
 // [[Rcpp::export]]
 NumericMatrix c_generate_permutations(NumericVector v) {
-  long long N{v.length()};
-  // calculate factorial of N to pre-size matrix
-  long nperms{1};
-  for (long i = 1; i <= N; ++i)
-    nperms *= i;
+  const int N{static_cast<int>(v.length())};
+  // the matrix has N! columns, which must be counted by an int
+  if (N > max_stored_n)
+    stop("The permutations of more than %i values are too many to store. "
+         "Exact c-values enumerate permutations without storing them.", max_stored_n);
+  const int nperms{static_cast<int>(opa::factorial(N))};
   // preallocate matrix
   NumericMatrix perms(N, nperms);
   perms(_,0) = v; // a is the first permutation
-  for (long m = 1; m < nperms; m++) {
+  for (int m = 1; m < nperms; m++) {
     std::next_permutation(v.begin(), v.end());
     perms(_,m) = v;
   }
   return perms;
 }
+
+/*
+ * Calculate PCCs for every row of a data matrix in a single pass. The
+ * hypothesis ordering is computed and packed once and reused for every
+ * complete row. For rows containing NAs the observed values and the
+ * corresponding hypothesis elements are gathered using an index of observed
+ * columns built in one scan of the matrix. Differences, signs and
+ * comparisons are fused so that no intermediate vectors are created per row.
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: h, a NumericVector hypothesis with length equal to ncol(dat).
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * param: diff_threshold, a positive double.
+ * return: a List containing individual PCCs, the per-row numbers of correct
+ * and total pairs, and the pooled numbers of correct and total pairs.
+ */
+// [[Rcpp::export]]
+List c_pcc_matrix(SEXP dat, NumericVector h, String pairing_type, double diff_threshold) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const opa::ObservedIndex index(data, nullptr, data.n_rows);
+  const bool pairwise{pairing_type == "pairwise"};
+
+  std::vector<int> h_ord;
+  opa::ordering(h.begin(), data.n_cols, pairwise, 0, h_ord);
+  opa::SignBits h_bits;
+  opa::pack_sign_bits(h_ord.data(), static_cast<int>(h_ord.size()), h_bits);
+  std::vector<std::int8_t> h_signs;
+  opa::pack_signs(h_ord.data(), static_cast<int>(h_ord.size()), h_signs);
+
+  NumericVector individual_pccs(data.n_rows);
+  IntegerVector individual_correct_pairs(data.n_rows);
+  IntegerVector individual_pairs(data.n_rows);
+  double correct_pairs{0};
+  double total_pairs{0};
+  // reusable buffers holding the observed values of a row and the
+  // corresponding hypothesis elements
+  std::vector<double> row(data.n_cols);
+  std::vector<double> row_h(data.n_cols);
+
+  for (int r = 0; r < data.n_rows; r++) {
+    const int n{index.gather(r, h.begin(), row.data(), row_h.data())};
+    int correct;
+    if (index.complete(r))
+      correct = opa::count_matches(row.data(), n, pairwise, diff_threshold, h_bits,
+                                   h_signs.data());
+    else
+      correct = opa::count_matches_hypothesis(row.data(), row_h.data(), n, pairwise, diff_threshold);
+    int pairs{opa::n_pairs(n, pairwise)};
+    individual_pccs[r] = opa::pcc_value(correct, pairs);
+    individual_correct_pairs[r] = correct;
+    individual_pairs[r] = pairs;
+    correct_pairs += correct;
+    total_pairs += pairs;
+  }
+  return List::create(_["individual_pccs"] = individual_pccs,
+                      _["individual_correct_pairs"] = individual_correct_pairs,
+                      _["individual_pairs"] = individual_pairs,
+                      _["correct_pairs"] = correct_pairs,
+                      _["total_pairs"] = total_pairs);
+}
+
+/*
+ * Calculate PCCs for every row of a data matrix at each of a vector of
+ * difference thresholds in a single pass. The pairwise differences of each
+ * row are computed once and the matches at every threshold are counted from
+ * their sorted absolute values, so the cost grows with the number of
+ * thresholds only through a single merge per row. The counts are identical
+ * to those of c_pcc_matrix() at each threshold. Rows are processed in
+ * parallel using nthreads threads.
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: h, a NumericVector hypothesis with length equal to ncol(dat).
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * param: thresholds, a NumericVector of non-negative difference thresholds,
+ * in any order.
+ * param: nthreads, the number of threads to use.
+ * return: a List containing matrices individual_pccs and
+ * individual_correct_pairs with 1 row per individual and 1 column per
+ * threshold, the per-row numbers of pairs individual_pairs, the pooled
+ * numbers of correct pairs at each threshold correct_pairs, and the pooled
+ * number of pairs total_pairs.
+ */
+// [[Rcpp::export]]
+List c_pcc_threshold_sweep(SEXP dat, NumericVector h, String pairing_type,
+                           NumericVector thresholds, int nthreads) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const opa::ObservedIndex index(data, nullptr, data.n_rows);
+  const bool pairwise{pairing_type == "pairwise"};
+  const int n_thresholds{static_cast<int>(thresholds.length())};
+
+  // the thresholds are swept in ascending order and the counts stored in
+  // the order given
+  std::vector<int> order(n_thresholds);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&](int a, int b) { return thresholds[a] < thresholds[b]; });
+  std::vector<double> sorted_thresholds(n_thresholds);
+  for (int k = 0; k < n_thresholds; k++)
+    sorted_thresholds[k] = thresholds[order[k]];
+
+  std::vector<int> full_h_ord;
+  opa::ordering(h.begin(), data.n_cols, pairwise, 0, full_h_ord);
+
+  NumericMatrix individual_pccs(data.n_rows, n_thresholds);
+  IntegerMatrix individual_correct_pairs(data.n_rows, n_thresholds);
+  IntegerVector individual_pairs(data.n_rows);
+  double* pccs_out{individual_pccs.begin()};
+  int* correct_out{individual_correct_pairs.begin()};
+  int* pairs_out{individual_pairs.begin()};
+  const double* hyp{h.begin()};
+
+  // reusable buffers of each worker
+  struct SweepScratch {
+    std::vector<double> row, row_h, tied, directed;
+    std::vector<int> h_ord, counts;
+  };
+  const int workers{opa::n_workers(data.n_rows, nthreads)};
+  std::vector<SweepScratch> scratch(workers);
+  for (SweepScratch& s : scratch) {
+    s.row.resize(data.n_cols);
+    s.row_h.resize(data.n_cols);
+    s.counts.resize(n_thresholds);
+    s.tied.reserve(opa::n_pairs(data.n_cols, pairwise));
+    s.directed.reserve(opa::n_pairs(data.n_cols, pairwise));
+  }
+
+  opa::parallel_for(data.n_rows, nthreads, [&](std::size_t r, int worker) {
+    SweepScratch& s{scratch[worker]};
+    const int i{static_cast<int>(r)};
+    const int n{index.gather(i, hyp, s.row.data(), s.row_h.data())};
+    const int* h_ord{full_h_ord.data()};
+    if (!index.complete(i)) {
+      opa::ordering(s.row_h.data(), n, pairwise, 0, s.h_ord);
+      h_ord = s.h_ord.data();
+    }
+    opa::count_matches_sweep(s.row.data(), n, pairwise, h_ord, sorted_thresholds.data(),
+                             n_thresholds, s.counts.data(), s.tied, s.directed);
+    const int pairs{opa::n_pairs(n, pairwise)};
+    for (int k = 0; k < n_thresholds; k++) {
+      const std::size_t idx{static_cast<std::size_t>(order[k]) * data.n_rows + r};
+      correct_out[idx] = s.counts[k];
+      pccs_out[idx] = opa::pcc_value(s.counts[k], pairs);
+    }
+    pairs_out[r] = pairs;
+  });
+
+  NumericVector correct_pairs(n_thresholds);
+  double total_pairs{0};
+  for (int r = 0; r < data.n_rows; r++)
+    total_pairs += individual_pairs[r];
+  for (int k = 0; k < n_thresholds; k++) {
+    const int* column{correct_out + static_cast<std::size_t>(k) * data.n_rows};
+    correct_pairs[k] = std::accumulate(column, column + data.n_rows, 0.0);
+  }
+  return List::create(_["individual_pccs"] = individual_pccs,
+                      _["individual_correct_pairs"] = individual_correct_pairs,
+                      _["individual_pairs"] = individual_pairs,
+                      _["correct_pairs"] = correct_pairs,
+                      _["total_pairs"] = total_pairs);
+}
+
+/*
+ * Calculate the number of permutations of a data row with a PCC at least as
+ * great as the observed PCC by visiting every permutation in place, without
+ * generating a matrix of permutations. Memory use is constant in the number
+ * of permutations. The observed PCC is that of v in its original order.
+ * Permutations of tied values are visited once and counted with the number
+ * of rearrangements of the tied values, so counts are over all n!
+ * permutations.
+ * param: v, a NumericVector containing a data row with NAs removed.
+ * param: H_ord, an IntegerVector of the ordinal relations in the hypothesis.
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * param: diff_threshold, a positive double.
+ * param: histogram, a bool indicating whether to return a histogram of
+ * permutation PCCs.
+ * return: a List containing the count n_perms_greater_eq, the number of
+ * permutations n_perms and, if requested, a vector pcc_hist in which element
+ * k + 1 is the number of permutations with k correctly classified pairs.
+ */
+// [[Rcpp::export]]
+List c_exact_perm_counts(NumericVector v, IntegerVector H_ord, String pairing_type,
+                         double diff_threshold, bool histogram) {
+  const int n{static_cast<int>(v.length())};
+  if (n > opa::max_exact_n)
+    stop("Exact c-values are limited to %i conditions per individual. "
+         "Use cval_method = 'stochastic' instead.", opa::max_exact_n);
+  // permute a copy so the R vector is never modified
+  std::vector<double> perm(v.begin(), v.end());
+  const bool pairwise{pairing_type == "pairwise"};
+  NumericVector pcc_hist(histogram ? opa::n_pairs(n, pairwise) + 1 : 0);
+  double* hist{histogram ? pcc_hist.begin() : nullptr};
+
+  unsigned long long n_perms_greater_eq;
+  opa::SignBits bits;
+  const opa::PermutationCounts<double> count{perm.data(), n, hist, nullptr};
+  if (pairwise)
+    n_perms_greater_eq = opa::with_permutation_scorer<opa::Pairwise>(
+      H_ord.begin(), n, diff_threshold, bits, count);
+  else
+    n_perms_greater_eq = opa::with_permutation_scorer<opa::Adjacent>(
+      H_ord.begin(), n, diff_threshold, bits, count);
+  return List::create(_["n_perms_greater_eq"] = static_cast<double>(n_perms_greater_eq),
+                      _["n_perms"] = static_cast<double>(opa::factorial(n)),
+                      _["pcc_hist"] = pcc_hist);
+}
+
+/*
+ * Calculate the exact distribution of the number of correctly classified
+ * pairs over every permutation of a data row containing no repeated values,
+ * when no difference threshold is applied. The distribution depends only on
+ * the hypothesis, so it can be reused for every such row.
+ * param: h, a NumericVector hypothesis with elements corresponding to NAs in
+ * the data row removed.
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * return: a NumericVector in which element k + 1 is the number of
+ * permutations with k correctly classified pairs.
+ */
+// [[Rcpp::export]]
+NumericVector c_null_distribution(NumericVector h, String pairing_type) {
+  const int n{static_cast<int>(h.length())};
+  if (n > opa::max_exact_n)
+    stop("Exact c-values are limited to %i conditions per individual. "
+         "Use cval_method = 'stochastic' instead.", opa::max_exact_n);
+  std::vector<double> dist;
+  if (pairing_type == "pairwise") {
+    dist = opa::pairwise_null_distribution(h.begin(), n);
+  } else {
+    std::vector<int> h_ord;
+    opa::ordering(h.begin(), n, false, 0, h_ord);
+    dist = opa::adjacent_null_distribution(h_ord.data(), n);
+  }
+  return NumericVector(dist.begin(), dist.end());
+}
@@ -0,0 +1,955 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <Rcpp.h>
+#include "data_matrix.h"
+#include "engine.h"
+#include "r_monitor.h"
+#include "rng.h"
+#include "threads.h"
+
+using namespace Rcpp;
+
+/*
+ * Stop if any of the indexed rows has more non-missing values than can be
+ * enumerated exactly. This is checked on the main thread because the R API
+ * must not be used from worker threads.
+ */
+static void check_exact_rows(const opa::ObservedIndex& index) {
+  for (int i = 0; i < index.n_rows(); i++)
+    if (index.n_observed(i) > opa::max_exact_n)
+      stop("Exact c-values are limited to %i conditions per individual. "
+           "Use cval_method = 'stochastic' instead.", opa::max_exact_n);
+}
+
+/*
+ * The total number of scratch buffer allocations made by a set of workers.
+ */
+static double scratch_allocations(const std::vector<opa::RowScratch>& scratch) {
+  double allocations{0};
+  for (std::size_t w = 0; w < scratch.size(); w++)
+    allocations += scratch[w].allocations;
+  return allocations;
+}
+
+/*
+ * A range of the distinct permutations of a row, by lexicographic rank.
+ */
+struct PermutationRange {
+  int row;
+  unsigned long long first;
+  unsigned long long last;
+};
+
+/*
+ * Find the rows of index whose exact c-value counts are certain to equal
+ * those of an earlier row, which has the same key as computed by row_key().
+ * The keys are hashed in parallel and the hashes grouped on the calling
+ * thread; rows sharing a hash are compared by their keys, so a collision
+ * only means that a row is scored itself. Sets representative[i] to the
+ * first row with the key of row i, and returns the rows which are their own
+ * representatives, in order. The time each worker spends hashing is added to
+ * busy.
+ */
+static std::vector<int> unique_rows(const opa::ObservedIndex& index, const double* h,
+                                    double diff_threshold, int nthreads,
+                                    std::vector<opa::RowScratch>& scratch,
+                                    std::vector<int>& representative,
+                                    std::vector<double>& busy) {
+  const int n_rows{index.n_rows()};
+  std::vector<std::uint64_t> hashes(n_rows);
+  opa::timed_parallel_for(n_rows, nthreads, busy, [&](std::size_t i, int worker) {
+    hashes[i] = opa::row_key(index, static_cast<int>(i), h, diff_threshold, scratch[worker],
+                             scratch[worker].key);
+  });
+
+  std::vector<int> uniques;
+  std::unordered_map<std::uint64_t, int> first_with_hash;
+  opa::RowScratch& s = scratch[0];
+  std::vector<double> first_key(s.key.capacity());
+  representative.resize(n_rows);
+  for (int r = 0; r < n_rows; r++) {
+    representative[r] = r;
+    std::unordered_map<std::uint64_t, int>::const_iterator it{first_with_hash.find(hashes[r])};
+    if (it == first_with_hash.end()) {
+      first_with_hash.insert(std::make_pair(hashes[r], r));
+    } else {
+      opa::row_key(index, it->second, h, diff_threshold, s, first_key);
+      opa::row_key(index, r, h, diff_threshold, s, s.key);
+      if (first_key == s.key) {
+        representative[r] = it->second;
+        continue;
+      }
+    }
+    uniques.push_back(r);
+  }
+  return uniques;
+}
+
+/*
+ * Calculate the exact c-value counts of every row of index, as described for
+ * c_exact_cvals(). Sets cache_hits to the number of rows whose counts were
+ * copied from an identical earlier row, adds the time each worker spends
+ * scoring to busy, and returns the number of scratch buffer allocations made.
+ * The monitor is polled while rows are scored, and its progress counts the
+ * distinct permutations enumerated, with 1 for each row scored from a null
+ * distribution; if it is cancelled the counts are incomplete.
+ */
+template <typename Pairing>
+static double exact_rows(const opa::ObservedIndex& index, const double* h, int n_cols,
+                         double diff_threshold, int nthreads, double* n_perms,
+                         double* n_perms_greater_eq, double* hist, int hist_rows,
+                         double& cache_hits, std::vector<double>& busy,
+                         RMonitor& monitor) {
+  const int n_rows{index.n_rows()};
+  const int workers{opa::n_workers(std::max(n_rows, nthreads), nthreads)};
+  std::vector<int> full_h_ord;
+  opa::ordering(h, n_cols, Pairing::pairwise, 0, full_h_ord);
+  opa::NullDistributionCache cache(Pairing::pairwise);
+  std::vector<opa::RowScratch> scratch(workers, opa::RowScratch(n_cols));
+  std::vector<int> representative;
+  const std::vector<int> uniques{unique_rows(index, h, diff_threshold, nthreads, scratch,
+                                             representative, busy)};
+  cache_hits = n_rows - static_cast<double>(uniques.size());
+
+  // the work of each row is its number of distinct permutations, or 1 if it
+  // is scored from a cached null distribution
+  std::vector<unsigned long long> row_perms(n_rows, 0);
+  opa::timed_parallel_for(uniques.size(), nthreads, busy, [&](std::size_t u, int worker) {
+    opa::RowScratch& s = scratch[worker];
+    const int r{uniques[u]};
+    const int n{index.gather(r, h, s.values.data(), s.hs.data())};
+    row_perms[r] = opa::uses_null_distribution(n, diff_threshold, s)
+      ? 1 : opa::distinct_permutations(n, s);
+  });
+  double total_perms{0};
+  for (std::size_t u = 0; u < uniques.size(); u++)
+    total_perms += static_cast<double>(row_perms[uniques[u]]);
+  monitor.set_total(total_perms);
+
+  // rows with enough permutations to be worth splitting between workers are
+  // set aside
+  std::vector<char> split(n_rows, 0);
+  opa::timed_parallel_for(uniques.size(), nthreads, busy, [&](std::size_t u, int worker) {
+    opa::RowScratch& s = scratch[worker];
+    const int r{uniques[u]};
+    if (opa::permutation_ranges(row_perms[r], workers) > 1) {
+      split[r] = 1;
+      return;
+    }
+    double* row_hist{hist ? hist + static_cast<std::size_t>(r) * hist_rows : nullptr};
+    opa::RowCounts counts{opa::exact_row<Pairing>(index, r, h, full_h_ord, diff_threshold,
+                                                  cache, s, row_hist, &monitor.progress)};
+    n_perms[r] = counts.n_perms;
+    n_perms_greater_eq[r] = counts.n_perms_greater_eq;
+    s.track();
+  }, &monitor);
+  if (monitor.interrupted())
+    return scratch_allocations(scratch);
+
+  // the distinct permutations of each row set aside are split into rank
+  // ranges, which are scored in parallel and then summed
+  std::vector<PermutationRange> ranges;
+  for (int r = 0; r < n_rows; r++) {
+    if (!split[r])
+      continue;
+    const unsigned long long total{row_perms[r]};
+    const int n_ranges{opa::permutation_ranges(total, workers)};
+    for (int k = 0; k < n_ranges; k++) {
+      PermutationRange range{r, total / n_ranges * k,
+                             k + 1 == n_ranges ? total : total / n_ranges * (k + 1)};
+      ranges.push_back(range);
+    }
+  }
+  std::vector<unsigned long long> range_greater_eq(ranges.size());
+  std::vector<unsigned long long> range_hist(hist ? ranges.size() * hist_rows : 0);
+  opa::timed_parallel_for(ranges.size(), nthreads, busy, [&](std::size_t k, int worker) {
+    range_greater_eq[k] = opa::exact_row_range<Pairing>(
+      index, ranges[k].row, h, full_h_ord, diff_threshold, ranges[k].first, ranges[k].last,
+      scratch[worker], hist ? range_hist.data() + k * hist_rows : nullptr, &monitor.progress);
+    scratch[worker].track();
+  }, &monitor);
+  std::vector<unsigned long long> row_greater_eq(n_rows, 0);
+  for (std::size_t k = 0; k < ranges.size(); k++) {
+    const int r{ranges[k].row};
+    row_greater_eq[r] += range_greater_eq[k];
+    if (hist)
+      for (int c = 0; c < hist_rows; c++)
+        hist[static_cast<std::size_t>(r) * hist_rows + c] +=
+          static_cast<double>(range_hist[k * hist_rows + c]);
+  }
+  for (int r = 0; r < n_rows; r++) {
+    if (split[r]) {
+      n_perms[r] = static_cast<double>(opa::factorial(index.n_observed(r)));
+      n_perms_greater_eq[r] = static_cast<double>(row_greater_eq[r]);
+    }
+  }
+
+  // rows sharing the key of an earlier row copy its counts
+  for (int r = 0; r < n_rows; r++) {
+    const int first{representative[r]};
+    if (first == r)
+      continue;
+    n_perms[r] = n_perms[first];
+    n_perms_greater_eq[r] = n_perms_greater_eq[first];
+    if (hist)
+      std::copy(hist + static_cast<std::size_t>(first) * hist_rows,
+                hist + static_cast<std::size_t>(first + 1) * hist_rows,
+                hist + static_cast<std::size_t>(r) * hist_rows);
+  }
+  return scratch_allocations(scratch);
+}
+
+/*
+ * Calculate exact c-value counts for a set of rows of a data matrix. Rows
+ * are processed in parallel, and the permutations of rows large enough to
+ * keep several threads busy are split into ranges by lexicographic rank,
+ * which are processed in parallel. Rows certain to have the same counts as an
+ * earlier row, because they have the same observed hypothesis elements and,
+ * with no difference threshold, the same ranks, or otherwise the same
+ * values, copy its counts instead of being scored again. Counts are summed
+ * exactly, so results are identical for any number of threads. The calling
+ * thread checks for a user interrupt, and updates the progress bar, while
+ * the workers run; an interrupt stops the workers within a batch of
+ * permutations and is then raised in R.
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: h, a NumericVector hypothesis with length equal to ncol(dat).
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * param: diff_threshold, a positive double.
+ * param: histogram, a bool indicating whether to return histograms of
+ * permutation PCCs.
+ * param: rows, an IntegerVector of the (1-based) rows to process.
+ * param: nthreads, the number of threads to use.
+ * param: progress, a bool indicating whether to display a progress bar of
+ * the distinct permutations enumerated.
+ * return: a List containing vectors n_perms and n_perms_greater_eq with 1
+ * element per row, a matrix pcc_hist with 1 column per row in which
+ * element [k + 1, i] is the number of permutations with k correct pairs, and
+ * the number of scratch buffer allocations made, scratch_allocations, the
+ * number of rows whose counts were copied from an earlier row, cache_hits,
+ * the elapsed time of the call in seconds, seconds, and the time each of
+ * nthreads workers spent scoring rows, worker_seconds.
+ */
+// [[Rcpp::export]]
+List c_exact_cvals(SEXP dat, NumericVector h, String pairing_type,
+                   double diff_threshold, bool histogram, IntegerVector rows,
+                   int nthreads, bool progress) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const opa::ObservedIndex index(data, rows.begin(), static_cast<int>(rows.length()));
+  check_exact_rows(index);
+  const bool pairwise{pairing_type == "pairwise"};
+  const int n_rows{static_cast<int>(rows.length())};
+  const int hist_rows{opa::n_pairs(data.n_cols, pairwise) + 1};
+  NumericVector n_perms(n_rows);
+  NumericVector n_perms_greater_eq(n_rows);
+  NumericMatrix pcc_hist(histogram ? hist_rows : 0, histogram ? n_rows : 0);
+  double* hist{histogram ? pcc_hist.begin() : nullptr};
+
+  const std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+  std::vector<double> busy(std::max(nthreads, 1), 0);
+  RMonitor monitor(progress);
+  double allocations;
+  double cache_hits;
+  if (pairwise)
+    allocations = exact_rows<opa::Pairwise>(index, h.begin(), data.n_cols, diff_threshold,
+                                            nthreads, n_perms.begin(),
+                                            n_perms_greater_eq.begin(), hist, hist_rows,
+                                            cache_hits, busy, monitor);
+  else
+    allocations = exact_rows<opa::Adjacent>(index, h.begin(), data.n_cols, diff_threshold,
+                                            nthreads, n_perms.begin(),
+                                            n_perms_greater_eq.begin(), hist, hist_rows,
+                                            cache_hits, busy, monitor);
+
+  monitor.finish();
+  return List::create(_["n_perms"] = n_perms,
+                      _["n_perms_greater_eq"] = n_perms_greater_eq,
+                      _["pcc_hist"] = pcc_hist,
+                      _["scratch_allocations"] = allocations,
+                      _["cache_hits"] = cache_hits,
+                      _["seconds"] = opa::seconds_since(start),
+                      _["worker_seconds"] = busy);
+}
+
+/*
+ * Calculate the number of distinct permutations of each of a set of rows of
+ * a data matrix which c_exact_cvals() would enumerate, so that the
+ * permutations of large rows can be split into ranges by
+ * c_exact_range_cvals(). Rows scored from a cached null distribution, which
+ * are never enumerated, have 0.
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: h, a NumericVector hypothesis with length equal to ncol(dat).
+ * param: diff_threshold, a positive double.
+ * param: rows, an IntegerVector of the (1-based) rows to process.
+ * return: a NumericVector with 1 element per row.
+ */
+// [[Rcpp::export]]
+NumericVector c_exact_row_perms(SEXP dat, NumericVector h, double diff_threshold,
+                                IntegerVector rows) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const opa::ObservedIndex index(data, rows.begin(), static_cast<int>(rows.length()));
+  check_exact_rows(index);
+  NumericVector row_perms(index.n_rows());
+  opa::RowScratch s(data.n_cols);
+  for (int r = 0; r < index.n_rows(); r++) {
+    const int n{index.gather(r, h.begin(), s.values.data(), s.hs.data())};
+    row_perms[r] = opa::uses_null_distribution(n, diff_threshold, s)
+      ? 0 : static_cast<double>(opa::distinct_permutations(n, s));
+  }
+  return row_perms;
+}
+
+/*
+ * Score the distinct permutations of the only row of index with
+ * lexicographic ranks in [first, last), split into ranges which are scored
+ * in parallel, adding the number of permutations with k correct pairs to
+ * hist[k] if hist is not null. Returns the number of permutations at least
+ * as great as the observed row, and adds the number of scratch buffer
+ * allocations made to allocations. Progress and interrupts are handled as by
+ * exact_rows().
+ */
+template <typename Pairing>
+static unsigned long long exact_range(const opa::ObservedIndex& index, const double* h,
+                                      int n_cols, double diff_threshold,
+                                      unsigned long long first, unsigned long long last,
+                                      int nthreads, unsigned long long* hist, int hist_rows,
+                                      double& allocations, std::vector<double>& busy,
+                                      RMonitor& monitor) {
+  std::vector<int> full_h_ord;
+  opa::ordering(h, n_cols, Pairing::pairwise, 0, full_h_ord);
+  const unsigned long long total{last - first};
+  monitor.set_total(static_cast<double>(total));
+  if (total == 0)
+    return 0;
+  const int n_ranges{opa::permutation_ranges(total, opa::n_workers(total, nthreads))};
+  std::vector<opa::RowScratch> scratch(opa::n_workers(n_ranges, nthreads),
+                                       opa::RowScratch(n_cols));
+  std::vector<unsigned long long> range_greater_eq(n_ranges, 0);
+  std::vector<unsigned long long> range_hist(hist ? static_cast<std::size_t>(n_ranges) * hist_rows
+                                                  : 0);
+  opa::timed_parallel_for(n_ranges, nthreads, busy, [&](std::size_t k, int worker) {
+    const unsigned long long range_first{first + total / n_ranges * k};
+    const unsigned long long range_last{k + 1 == static_cast<std::size_t>(n_ranges)
+                                        ? last : first + total / n_ranges * (k + 1)};
+    range_greater_eq[k] = opa::exact_row_range<Pairing>(
+      index, 0, h, full_h_ord, diff_threshold, range_first, range_last, scratch[worker],
+      hist ? range_hist.data() + k * hist_rows : nullptr, &monitor.progress);
+    scratch[worker].track();
+  }, &monitor);
+  unsigned long long greater_eq{0};
+  for (int k = 0; k < n_ranges; k++) {
+    greater_eq += range_greater_eq[k];
+    if (hist)
+      for (int c = 0; c < hist_rows; c++)
+        hist[c] += range_hist[static_cast<std::size_t>(k) * hist_rows + c];
+  }
+  allocations += scratch_allocations(scratch);
+  return greater_eq;
+}
+
+/*
+ * Calculate the exact c-value counts of the distinct permutations of a
+ * single row of a data matrix with lexicographic ranks in [first, last), as
+ * enumerated by c_exact_cvals(), so that the permutations of a large row can
+ * be shared between machines. Summed over ranges covering every distinct
+ * permutation of the row, the counts are those computed by c_exact_cvals().
+ * The range is scored in parallel, and interrupts and progress are handled
+ * as by c_exact_cvals(). first and last are passed as doubles, so must be
+ * exact integers below 2^53.
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: h, a NumericVector hypothesis with length equal to ncol(dat).
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * param: diff_threshold, a positive double.
+ * param: histogram, a bool indicating whether to return a histogram of
+ * permutation PCCs.
+ * param: row, the (1-based) row to process.
+ * param: first, the rank of the first distinct permutation to score.
+ * param: last, one more than the rank of the last distinct permutation.
+ * param: nthreads, the number of threads to use.
+ * param: progress, a bool indicating whether to display a progress bar of
+ * the distinct permutations enumerated.
+ * return: a List containing the number of permutations of the row, n_perms,
+ * the number in the range at least as great as the observed row,
+ * n_perms_greater_eq, a vector pcc_hist in which element k + 1 is the number
+ * in the range with k correct pairs, or of length 0 if histogram is false,
+ * and scratch_allocations, seconds and worker_seconds as returned by
+ * c_exact_cvals().
+ */
+// [[Rcpp::export]]
+List c_exact_range_cvals(SEXP dat, NumericVector h, String pairing_type,
+                         double diff_threshold, bool histogram, int row, double first,
+                         double last, int nthreads, bool progress) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const opa::ObservedIndex index(data, &row, 1);
+  check_exact_rows(index);
+  const bool pairwise{pairing_type == "pairwise"};
+  const int hist_rows{opa::n_pairs(data.n_cols, pairwise) + 1};
+  std::vector<unsigned long long> hist(histogram ? hist_rows : 0, 0);
+  if (!(first >= 0 && last >= first))
+    stop("The range of permutations must be a non-negative, increasing pair of ranks");
+  const unsigned long long range_first{static_cast<unsigned long long>(first)};
+  const unsigned long long range_last{static_cast<unsigned long long>(last)};
+
+  const std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+  std::vector<double> busy(std::max(nthreads, 1), 0);
+  RMonitor monitor(progress);
+  double allocations{0};
+  unsigned long long greater_eq;
+  unsigned long long* hist_out{histogram ? hist.data() : nullptr};
+  if (pairwise)
+    greater_eq = exact_range<opa::Pairwise>(index, h.begin(), data.n_cols, diff_threshold,
+                                            range_first, range_last, nthreads, hist_out,
+                                            hist_rows, allocations, busy, monitor);
+  else
+    greater_eq = exact_range<opa::Adjacent>(index, h.begin(), data.n_cols, diff_threshold,
+                                            range_first, range_last, nthreads, hist_out,
+                                            hist_rows, allocations, busy, monitor);
+
+  monitor.finish();
+  NumericVector pcc_hist(hist.size());
+  for (std::size_t c = 0; c < hist.size(); c++)
+    pcc_hist[c] = static_cast<double>(hist[c]);
+  return List::create(_["n_perms"] = static_cast<double>(opa::factorial(index.n_observed(0))),
+                      _["n_perms_greater_eq"] = static_cast<double>(greater_eq),
+                      _["pcc_hist"] = pcc_hist,
+                      _["scratch_allocations"] = allocations,
+                      _["seconds"] = opa::seconds_since(start),
+                      _["worker_seconds"] = busy);
+}
+
+/*
+ * Score nreps random reorderings of the n values (or ranks) in v, shuffling
+ * v in place and scoring each replicate as soon as it is generated, until
+ * the stopping rule is satisfied. Sets reps to the number of replicates used
+ * and returns the number with at least as many correct pairs as v itself.
+ * If pccs is not null the PCC of each replicate is stored in it; if hist is
+ * not null the number of replicates with k correct pairs is added to hist[k].
+ * Each of the nreps replicates, whether used or not once sampling stops, is
+ * added to progress, and sampling stops early if the work is cancelled.
+ */
+template <typename T, typename Scorer>
+static double sample_row(T* v, int n, const Scorer& scorer, int nreps,
+                         const opa::StoppingRule& rule, opa::Xoshiro256& rng,
+                         double* pccs, double* hist, int& reps, opa::Progress& progress) {
+  const int pairs{scorer.n_pairs()};
+  const int observed{scorer.correct(v)};
+  double n_greater_eq{0};
+  opa::ProgressTicker ticker(&progress);
+  reps = 0;
+  while (reps < nreps) {
+    opa::shuffle(v, n, rng);
+    const int correct{scorer.correct(v)};
+    if (correct >= observed && pairs > 0)
+      n_greater_eq++;
+    if (pccs)
+      pccs[reps] = opa::pcc_value(correct, pairs);
+    if (hist)
+      hist[correct]++;
+    reps++;
+    if (!ticker.tick() || (rule.check(reps) && rule.resolved(n_greater_eq, reps)))
+      break;
+  }
+  ticker.tick(nreps - reps);
+  return n_greater_eq;
+}
+
+// sample_row() with a scorer chosen by with_rank_scorer() or with_permutation_scorer()
+template <typename T>
+struct RowSample {
+  typedef double result_type;
+  T* v;
+  int n;
+  int nreps;
+  const opa::StoppingRule& rule;
+  opa::Xoshiro256& rng;
+  double* pccs;
+  double* hist;
+  int& reps;
+  opa::Progress& progress;
+
+  template <typename Scorer>
+  double operator()(const Scorer& scorer) const {
+    return sample_row(v, n, scorer, nreps, rule, rng, pccs, hist, reps, progress);
+  }
+};
+
+template <typename Pairing>
+static double stochastic_rows(const opa::ObservedIndex& index, const double* h, int n_cols,
+                            double diff_threshold, int nreps, const opa::StoppingRule& rule,
+                            std::uint64_t seed, const int* rows, int stream_offset,
+                            int nthreads, double* n_reps, double* n_perms_greater_eq,
+                            double* perm_pccs, double* hist, int hist_rows,
+                            std::vector<double>& busy, RMonitor& monitor) {
+  const int n_rows{index.n_rows()};
+  monitor.set_total(static_cast<double>(nreps) * n_rows);
+  std::vector<int> full_h_ord;
+  opa::ordering(h, n_cols, Pairing::pairwise, 0, full_h_ord);
+  // complete rows of more than max_fixed_n values share scorers built once
+  // for the whole hypothesis
+  const opa::RankScorer<Pairing> full_rank_scorer(full_h_ord.data(), n_cols);
+  const opa::PermutationScorer<Pairing> full_scorer(full_h_ord.data(), n_cols, diff_threshold);
+  std::vector<opa::RowScratch> scratch(opa::n_workers(n_rows, nthreads),
+                                       opa::RowScratch(n_cols));
+  opa::timed_parallel_for(n_rows, nthreads, busy, [&](std::size_t i, int worker) {
+    opa::RowScratch& s = scratch[worker];
+    const int r{static_cast<int>(i)};
+    const int n{index.gather(r, h, s.values.data(), s.hs.data())};
+    const std::vector<int>& h_ord = opa::row_ordering<Pairing>(index, r, n, full_h_ord, s);
+
+    // each row draws from its own stream, identified by its row number, and
+    // is reshuffled in place, as ranks if no difference threshold is applied
+    opa::Xoshiro256 rng(seed, static_cast<std::uint64_t>(rows[i] + stream_offset));
+    double* pccs{perm_pccs ? perm_pccs + i * static_cast<std::size_t>(nreps) : nullptr};
+    double* row_hist{hist ? hist + i * hist_rows : nullptr};
+    int reps;
+    const bool shared{index.complete(r) && n > opa::max_fixed_n};
+    if (diff_threshold == 0) {
+      opa::encode_ranks(s.values.data(), n, s.ranks.data(), s.sorted);
+      const RowSample<std::int32_t> sample{s.ranks.data(), n, nreps, rule, rng, pccs, row_hist,
+                                           reps, monitor.progress};
+      n_perms_greater_eq[i] = shared
+        ? sample(full_rank_scorer)
+        : opa::with_rank_scorer<Pairing>(h_ord.data(), n, s.h_signs, sample);
+    } else {
+      const RowSample<double> sample{s.values.data(), n, nreps, rule, rng, pccs, row_hist,
+                                     reps, monitor.progress};
+      n_perms_greater_eq[i] = shared
+        ? sample(full_scorer)
+        : opa::with_permutation_scorer<Pairing>(h_ord.data(), n, diff_threshold, s.h_bits,
+                                                sample);
+    }
+    n_reps[i] = reps;
+    s.track();
+  }, &monitor);
+  return scratch_allocations(scratch);
+}
+
+/*
+ * Calculate stochastic c-value counts for a set of rows of a data matrix.
+ * Each row is shuffled in place using its own random number stream, selected
+ * by seed and the row number plus stream_offset, so results are identical
+ * for any number of threads and however the rows are split between calls.
+ * Replicates are scored as they are generated, so memory use is independent
+ * of nreps unless a matrix of replicate PCCs is requested. Interrupts and
+ * progress are handled as by c_exact_cvals().
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: h, a NumericVector hypothesis with length equal to ncol(dat).
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * param: diff_threshold, a positive double.
+ * param: nreps, the number of random reorderings of each row.
+ * param: seed, a NumericVector of 2 integers in [0, 2^32) drawn in R.
+ * param: replicates, a String, either "none", "histogram" or "matrix".
+ * param: rows, an IntegerVector of the (1-based) rows to process.
+ * param: stream_offset, added to each row number to select its stream, so
+ * that rows appended to earlier data continue its numbering.
+ * param: nthreads, the number of threads to use.
+ * param: progress, a bool indicating whether to display a progress bar of
+ * the replicates drawn.
+ * return: a List containing a vector n_perms_greater_eq with 1 element per
+ * row and, if replicates is "histogram", a matrix pcc_hist in which element
+ * [k, i] is the number of replicates of row i with k - 1 correct pairs, or,
+ * if replicates is "matrix", a matrix perm_pccs of replicate PCCs with 1
+ * column per row, the number of scratch buffer allocations made,
+ * scratch_allocations, the elapsed time of the call in seconds, seconds, and
+ * the time each of nthreads workers spent sampling rows, worker_seconds.
+ */
+// [[Rcpp::export]]
+List c_stochastic_cvals(SEXP dat, NumericVector h, String pairing_type,
+                        double diff_threshold, int nreps, NumericVector seed,
+                        String replicates, IntegerVector rows, int stream_offset,
+                        int nthreads, bool progress) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const int n_rows{static_cast<int>(rows.length())};
+  const opa::ObservedIndex index(data, rows.begin(), n_rows);
+  NumericVector n_reps(n_rows);
+  NumericVector n_perms_greater_eq(n_rows);
+  const bool matrix{replicates == "matrix"};
+  const bool histogram{replicates == "histogram"};
+  const int hist_rows{opa::n_pairs(data.n_cols, pairing_type == "pairwise") + 1};
+  NumericMatrix perm_pccs(matrix ? nreps : 0, matrix ? n_rows : 0);
+  NumericMatrix pcc_hist(histogram ? hist_rows : 0, histogram ? n_rows : 0);
+  double* pccs{matrix ? perm_pccs.begin() : nullptr};
+  double* hist{histogram ? pcc_hist.begin() : nullptr};
+  const std::uint64_t stream_seed{opa::make_seed(seed[0], seed[1])};
+  const opa::StoppingRule rule;
+
+  const std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+  std::vector<double> busy(std::max(nthreads, 1), 0);
+  RMonitor monitor(progress);
+  double allocations;
+  if (pairing_type == "pairwise")
+    allocations = stochastic_rows<opa::Pairwise>(index, h.begin(), data.n_cols, diff_threshold,
+                                                 nreps, rule, stream_seed, rows.begin(),
+                                                 stream_offset, nthreads, n_reps.begin(),
+                                                 n_perms_greater_eq.begin(), pccs, hist,
+                                                 hist_rows, busy, monitor);
+  else
+    allocations = stochastic_rows<opa::Adjacent>(index, h.begin(), data.n_cols, diff_threshold,
+                                                 nreps, rule, stream_seed, rows.begin(),
+                                                 stream_offset, nthreads, n_reps.begin(),
+                                                 n_perms_greater_eq.begin(), pccs, hist,
+                                                 hist_rows, busy, monitor);
+
+  monitor.finish();
+  return List::create(_["n_perms_greater_eq"] = n_perms_greater_eq,
+                      _["perm_pccs"] = perm_pccs,
+                      _["pcc_hist"] = pcc_hist,
+                      _["scratch_allocations"] = allocations,
+                      _["seconds"] = opa::seconds_since(start),
+                      _["worker_seconds"] = busy);
+}
+
+/*
+ * Calculate adaptive stochastic c-value counts for a set of rows of a data
+ * matrix. Rows are reordered as in c_stochastic_cvals(), so with the same
+ * seed the replicates drawn for a row are a prefix of those drawn by
+ * c_stochastic_cvals(), but sampling of a row stops once its c-value is
+ * resolved. After every batch replicates a Wilson score interval is computed
+ * for the c-value, and sampling stops once the interval excludes
+ * cval_threshold or its half-width is no greater than cval_precision.
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: h, a NumericVector hypothesis with length equal to ncol(dat).
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * param: diff_threshold, a positive double.
+ * param: max_reps, the maximum number of random reorderings of each row.
+ * param: seed, a NumericVector of 2 integers in [0, 2^32) drawn in R.
+ * param: cval_threshold, the c-value decision threshold, in (0, 1).
+ * param: cval_precision, the interval half-width at which to stop, which may
+ * be 0 to stop only once the interval excludes cval_threshold.
+ * param: batch, the number of replicates between stopping checks.
+ * param: confidence, the coverage of the Wilson interval, in (0, 1).
+ * param: replicates, a String, either "none", "histogram" or "matrix".
+ * param: rows, an IntegerVector of the (1-based) rows to process.
+ * param: stream_offset, as for c_stochastic_cvals().
+ * param: nthreads, the number of threads to use.
+ * param: progress, as for c_stochastic_cvals(); replicates a row did not
+ * need are counted as done, so the progress bar still reaches max_reps per
+ * row.
+ * return: a List containing vectors n_reps and n_perms_greater_eq with 1
+ * element per row and, as for c_stochastic_cvals(), a histogram pcc_hist of
+ * the replicates used or a matrix perm_pccs with 1 column per row in which
+ * replicates beyond n_reps are NA, scratch_allocations, seconds and
+ * worker_seconds.
+ */
+// [[Rcpp::export]]
+List c_adaptive_cvals(SEXP dat, NumericVector h, String pairing_type,
+                      double diff_threshold, int max_reps, NumericVector seed,
+                      double cval_threshold, double cval_precision, int batch,
+                      double confidence, String replicates, IntegerVector rows,
+                      int stream_offset, int nthreads, bool progress) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const int n_rows{static_cast<int>(rows.length())};
+  const opa::ObservedIndex index(data, rows.begin(), n_rows);
+  NumericVector n_reps(n_rows);
+  NumericVector n_perms_greater_eq(n_rows);
+  const bool matrix{replicates == "matrix"};
+  const bool histogram{replicates == "histogram"};
+  const int hist_rows{opa::n_pairs(data.n_cols, pairing_type == "pairwise") + 1};
+  NumericMatrix perm_pccs(matrix ? max_reps : 0, matrix ? n_rows : 0);
+  std::fill(perm_pccs.begin(), perm_pccs.end(), NA_REAL);
+  NumericMatrix pcc_hist(histogram ? hist_rows : 0, histogram ? n_rows : 0);
+  double* pccs{matrix ? perm_pccs.begin() : nullptr};
+  double* hist{histogram ? pcc_hist.begin() : nullptr};
+  const std::uint64_t stream_seed{opa::make_seed(seed[0], seed[1])};
+  const opa::StoppingRule rule(batch, cval_threshold, cval_precision,
+                               R::qnorm(1 - (1 - confidence) / 2, 0, 1, 1, 0));
+
+  const std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+  std::vector<double> busy(std::max(nthreads, 1), 0);
+  RMonitor monitor(progress);
+  double allocations;
+  if (pairing_type == "pairwise")
+    allocations = stochastic_rows<opa::Pairwise>(index, h.begin(), data.n_cols, diff_threshold,
+                                                 max_reps, rule, stream_seed, rows.begin(),
+                                                 stream_offset, nthreads, n_reps.begin(),
+                                                 n_perms_greater_eq.begin(), pccs, hist,
+                                                 hist_rows, busy, monitor);
+  else
+    allocations = stochastic_rows<opa::Adjacent>(index, h.begin(), data.n_cols, diff_threshold,
+                                                 max_reps, rule, stream_seed, rows.begin(),
+                                                 stream_offset, nthreads, n_reps.begin(),
+                                                 n_perms_greater_eq.begin(), pccs, hist,
+                                                 hist_rows, busy, monitor);
+
+  monitor.finish();
+  return List::create(_["n_reps"] = n_reps,
+                      _["n_perms_greater_eq"] = n_perms_greater_eq,
+                      _["perm_pccs"] = perm_pccs,
+                      _["pcc_hist"] = pcc_hist,
+                      _["scratch_allocations"] = allocations,
+                      _["seconds"] = opa::seconds_since(start),
+                      _["worker_seconds"] = busy);
+}
+
+/*
+ * Per-thread buffers for c_multi_cvals(): the row being processed, the
+ * orderings of each hypothesis restricted to the row's observed values, the
+ * packed ordering of the current permutation of the row, and the histogram
+ * of each hypothesis for the row, if any. As for opa::RowScratch every
+ * buffer is sized once for rows of n_cols values.
+ */
+struct MultiScratch {
+  opa::RowScratch row;
+  std::vector<double> hs;
+  std::vector<std::vector<int> > h_ords;
+  std::vector<opa::SignBits> h_bits;
+  opa::SignBits row_bits;
+  std::vector<int> observed;
+  std::vector<double> n_greater_eq;
+  std::vector<double*> hists;
+
+  MultiScratch(int n_cols, int n_hyp)
+    : row(n_cols), hs(static_cast<std::size_t>(n_cols) * n_hyp), h_ords(n_hyp),
+      h_bits(n_hyp), observed(n_hyp), n_greater_eq(n_hyp), hists(n_hyp, nullptr) {
+    const int max_pairs{opa::n_pairs(n_cols, true)};
+    const std::size_t max_words{static_cast<std::size_t>(max_pairs + 63) / 64};
+    for (int k = 0; k < n_hyp; k++) {
+      h_ords[k].reserve(max_pairs);
+      h_bits[k].gt.reserve(max_words);
+      h_bits[k].lt.reserve(max_words);
+    }
+    row_bits.gt.reserve(max_words);
+    row_bits.lt.reserve(max_words);
+  }
+
+  MultiScratch(const MultiScratch& other)
+    : MultiScratch(static_cast<int>(other.row.values.size()),
+                   static_cast<int>(other.h_ords.size())) {}
+};
+
+/*
+ * Pack the current ordering of the n values in v once and compare it with
+ * every hypothesis, adding weight to the count of each hypothesis for which
+ * it has at least as many correct pairs as the observed data, and to
+ * element k of the histogram of each hypothesis, if any, for k correct pairs.
+ */
+template <typename Pairing>
+static void score_multi(const double* v, int n, double diff_threshold, int pairs,
+                        const std::vector<opa::SignBits>& h_bits, double weight,
+                        MultiScratch& s) {
+  opa::pack_row_bits<Pairing>(v, n, diff_threshold, s.row_bits);
+  for (std::size_t k = 0; k < h_bits.size(); k++) {
+    const int correct{opa::count_bit_matches(s.row_bits, h_bits[k], pairs)};
+    if (correct >= s.observed[k] && pairs > 0)
+      s.n_greater_eq[k] += weight;
+    if (s.hists[k])
+      s.hists[k][correct] += weight;
+  }
+}
+
+template <typename Pairing>
+static void multi_rows(const opa::ObservedIndex& index, const double* hyps, int n_cols,
+                       int n_hyp, double diff_threshold, bool exact, int nreps,
+                       std::uint64_t seed, const int* rows, int nthreads, double* correct,
+                       double* pccs, double* pairs, double* n_perms,
+                       double* n_perms_greater_eq, double* hist, int hist_rows,
+                       RMonitor& monitor) {
+  const int n_rows{index.n_rows()};
+  // complete rows share the orderings of the full hypotheses
+  std::vector<std::vector<int> > full_h_ords(n_hyp);
+  std::vector<opa::SignBits> full_h_bits(n_hyp);
+  std::vector<std::unique_ptr<opa::NullDistributionCache> > caches;
+  for (int k = 0; k < n_hyp; k++) {
+    opa::ordering(hyps + static_cast<std::size_t>(k) * n_cols, n_cols, Pairing::pairwise, 0,
+                  full_h_ords[k]);
+    opa::pack_sign_bits(full_h_ords[k].data(), static_cast<int>(full_h_ords[k].size()),
+                        full_h_bits[k]);
+    caches.push_back(std::unique_ptr<opa::NullDistributionCache>(
+      new opa::NullDistributionCache(Pairing::pairwise)));
+  }
+  std::vector<MultiScratch> scratch(opa::n_workers(n_rows, nthreads),
+                                    MultiScratch(n_cols, n_hyp));
+
+  // progress counts the distinct permutations of each row, with 1 for each
+  // row scored from null distributions, or its replicates
+  if (exact) {
+    std::vector<double> row_perms(n_rows);
+    opa::parallel_for(n_rows, nthreads, [&](std::size_t i, int worker) {
+      MultiScratch& s = scratch[worker];
+      const int n{index.gather(static_cast<int>(i), hyps, s.row.values.data(), s.hs.data())};
+      row_perms[i] = opa::uses_null_distribution(n, diff_threshold, s.row)
+        ? 1 : static_cast<double>(opa::distinct_permutations(n, s.row));
+    });
+    double total_perms{0};
+    for (int i = 0; i < n_rows; i++)
+      total_perms += row_perms[i];
+    monitor.set_total(total_perms);
+  } else {
+    monitor.set_total(static_cast<double>(nreps) * n_rows);
+  }
+
+  opa::parallel_for(n_rows, nthreads, [&](std::size_t i, int worker) {
+    MultiScratch& s = scratch[worker];
+    opa::ProgressTicker ticker(&monitor.progress);
+    const int r{static_cast<int>(i)};
+    const int n{index.gather(r, hyps, s.row.values.data(), s.hs.data())};
+    const int n_row_pairs{opa::n_pairs(n, Pairing::pairwise)};
+    for (int k = 1; k < n_hyp; k++)
+      index.subset(r, hyps + static_cast<std::size_t>(k) * n_cols,
+                   s.hs.data() + static_cast<std::size_t>(k) * n_cols);
+    if (!index.complete(r)) {
+      for (int k = 0; k < n_hyp; k++) {
+        opa::ordering(s.hs.data() + static_cast<std::size_t>(k) * n_cols, n, Pairing::pairwise,
+                      0, s.h_ords[k]);
+        opa::pack_sign_bits(s.h_ords[k].data(), n_row_pairs, s.h_bits[k]);
+      }
+    }
+    const std::vector<std::vector<int> >& h_ords = index.complete(r) ? full_h_ords : s.h_ords;
+    const std::vector<opa::SignBits>& h_bits = index.complete(r) ? full_h_bits : s.h_bits;
+
+    double* v{s.row.values.data()};
+    opa::pack_row_bits<Pairing>(v, n, diff_threshold, s.row_bits);
+    for (int k = 0; k < n_hyp; k++) {
+      s.observed[k] = opa::count_bit_matches(s.row_bits, h_bits[k], n_row_pairs);
+      s.n_greater_eq[k] = 0;
+      // the histograms of each hypothesis follow those of the previous one
+      s.hists[k] = hist ? hist + (static_cast<std::size_t>(k) * n_rows + i) * hist_rows
+                        : nullptr;
+    }
+
+    if (exact && opa::uses_null_distribution(n, diff_threshold, s.row)) {
+      // each hypothesis has its own cached null distribution
+      for (int k = 0; k < n_hyp; k++) {
+        const std::vector<double>& dist =
+          caches[k]->get(h_ords[k], s.hs.data() + static_cast<std::size_t>(k) * n_cols, n);
+        for (std::size_t c = s.observed[k]; c < dist.size(); c++)
+          s.n_greater_eq[k] += dist[c];
+        if (s.hists[k])
+          for (std::size_t c = 0; c < dist.size(); c++)
+            s.hists[k][c] += dist[c];
+      }
+      ticker.tick();
+      n_perms[i] = static_cast<double>(opa::factorial(n));
+    } else if (exact) {
+      // every distinct permutation is visited once, weighted by its
+      // multiplicity, and scored against every hypothesis, as in
+      // opa::enumerate_permutations()
+      std::sort(v, v + n);
+      const double weight{static_cast<double>(opa::multiset_weight(v, n))};
+      do {
+        score_multi<Pairing>(v, n, diff_threshold, n_row_pairs, h_bits, weight, s);
+        if (!ticker.tick())
+          break;
+      } while (std::next_permutation(v, v + n));
+      n_perms[i] = static_cast<double>(opa::factorial(n));
+    } else {
+      // the same stream, and so the same reorderings, as c_stochastic_cvals()
+      opa::Xoshiro256 rng(seed, static_cast<std::uint64_t>(rows[i]));
+      for (int rep = 0; rep < nreps; rep++) {
+        opa::shuffle(v, n, rng);
+        score_multi<Pairing>(v, n, diff_threshold, n_row_pairs, h_bits, 1, s);
+        if (!ticker.tick())
+          break;
+      }
+      n_perms[i] = nreps;
+    }
+
+    pairs[i] = n_row_pairs;
+    for (int k = 0; k < n_hyp; k++) {
+      correct[i + static_cast<std::size_t>(k) * n_rows] = s.observed[k];
+      pccs[i + static_cast<std::size_t>(k) * n_rows] = opa::pcc_value(s.observed[k], n_row_pairs);
+      n_perms_greater_eq[i + static_cast<std::size_t>(k) * n_rows] = s.n_greater_eq[k];
+    }
+  }, &monitor);
+}
+
+/*
+ * Fit several hypotheses to a set of rows of a data matrix in one pass. Each
+ * ordering of a row, observed or permuted, is computed and packed once and
+ * compared with every hypothesis, so the cost of generating and ordering
+ * permutations is shared by the whole batch. The permutations used are the
+ * same as those used by c_exact_cvals() or, for the same seed,
+ * c_stochastic_cvals(), so the results for each hypothesis are identical to
+ * fitting it alone.
+ * param: dat, a double matrix, or a data frame of double columns, with 1 row
+ * per individual.
+ * param: hypotheses, a NumericMatrix with 1 column per hypothesis and
+ * nrow(hypotheses) equal to ncol(dat).
+ * param: pairing_type, a String, either "adjacent" or "pairwise".
+ * param: diff_threshold, a positive double.
+ * param: cval_method, a String, either "exact" or "stochastic".
+ * param: nreps, the number of random reorderings of each row, ignored if
+ * cval_method is "exact".
+ * param: seed, a NumericVector of 2 integers in [0, 2^32) drawn in R.
+ * param: rows, an IntegerVector of the (1-based) rows to process.
+ * param: histogram, a bool indicating whether to return a histogram of
+ * permutation PCCs for each hypothesis.
+ * param: nthreads, the number of threads to use.
+ * param: progress, whether to draw a progress bar, counting the distinct
+ * permutations or replicates of every row. Interrupts are handled as by
+ * c_exact_cvals().
+ * return: a List containing matrices correct_pairs, individual_pccs and
+ * n_perms_greater_eq with 1 row per data row and 1 column per hypothesis,
+ * vectors n_pairs and n_perms with 1 element per data row, and a matrix
+ * pcc_hist holding, for each hypothesis in turn, 1 column per data row in
+ * which row k + 1 is the number of permutations with k correct pairs, with 0
+ * columns if histogram is false.
+ */
+// [[Rcpp::export]]
+List c_multi_cvals(SEXP dat, NumericMatrix hypotheses, String pairing_type,
+                   double diff_threshold, String cval_method, int nreps,
+                   NumericVector seed, IntegerVector rows, bool histogram, int nthreads,
+                   bool progress) {
+  const opa::DataMatrix data{opa::data_matrix(dat)};
+  const int n_rows{static_cast<int>(rows.length())};
+  const int n_hyp{hypotheses.ncol()};
+  const bool exact{cval_method == "exact"};
+  const opa::ObservedIndex index(data, rows.begin(), n_rows);
+  if (exact)
+    check_exact_rows(index);
+  NumericMatrix correct_pairs(n_rows, n_hyp);
+  NumericMatrix individual_pccs(n_rows, n_hyp);
+  NumericMatrix n_perms_greater_eq(n_rows, n_hyp);
+  NumericVector n_pairs(n_rows);
+  NumericVector n_perms(n_rows);
+  const int hist_rows{opa::n_pairs(data.n_cols, pairing_type == "pairwise") + 1};
+  NumericMatrix pcc_hist(histogram ? hist_rows : 0, histogram ? n_rows * n_hyp : 0);
+  double* hist{histogram ? pcc_hist.begin() : nullptr};
+  const std::uint64_t stream_seed{opa::make_seed(seed[0], seed[1])};
+
+  RMonitor monitor(progress);
+  if (pairing_type == "pairwise")
+    multi_rows<opa::Pairwise>(index, hypotheses.begin(), data.n_cols, n_hyp, diff_threshold,
+                              exact, nreps, stream_seed, rows.begin(), nthreads,
+                              correct_pairs.begin(), individual_pccs.begin(), n_pairs.begin(),
+                              n_perms.begin(), n_perms_greater_eq.begin(), hist, hist_rows,
+                              monitor);
+  else
+    multi_rows<opa::Adjacent>(index, hypotheses.begin(), data.n_cols, n_hyp, diff_threshold,
+                              exact, nreps, stream_seed, rows.begin(), nthreads,
+                              correct_pairs.begin(), individual_pccs.begin(), n_pairs.begin(),
+                              n_perms.begin(), n_perms_greater_eq.begin(), hist, hist_rows,
+                              monitor);
+  monitor.finish();
+
+  return List::create(_["correct_pairs"] = correct_pairs,
+                      _["individual_pccs"] = individual_pccs,
+                      _["n_pairs"] = n_pairs,
+                      _["n_perms"] = n_perms,
+                      _["n_perms_greater_eq"] = n_perms_greater_eq,
+                      _["pcc_hist"] = pcc_hist);
+}
@@ -0,0 +1,62 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Conversion of data passed from R to the engine's read-only view of it.
+ * Only this step uses the R API; the view itself refers to R's memory and
+ * can be shared with worker threads.
+ */
+
+#ifndef OPA_DATA_MATRIX_H
+#define OPA_DATA_MATRIX_H
+
+#include <Rcpp.h>
+#include "engine.h"
+
+namespace opa {
+
+/*
+ * A view of data passed from R, either a double matrix or a data frame of
+ * double columns. The columns of a data frame are separate vectors, so
+ * reading them in place avoids copying the data into a matrix.
+ */
+inline DataMatrix data_matrix(SEXP dat) {
+  DataMatrix data;
+  if (Rf_isNewList(dat)) {
+    data.n_cols = Rf_length(dat);
+    data.n_rows = data.n_cols > 0 ? Rf_length(VECTOR_ELT(dat, 0)) : 0;
+    for (int c = 0; c < data.n_cols; c++) {
+      SEXP col{VECTOR_ELT(dat, c)};
+      if (TYPEOF(col) != REALSXP || Rf_length(col) != data.n_rows)
+        Rcpp::stop("Every column of the data must be a double vector of the same length");
+      data.cols.push_back(REAL(col));
+    }
+  } else {
+    if (TYPEOF(dat) != REALSXP || !Rf_isMatrix(dat))
+      Rcpp::stop("The data must be a double matrix or a data frame");
+    data.n_rows = Rf_nrows(dat);
+    data.n_cols = Rf_ncols(dat);
+    for (int c = 0; c < data.n_cols; c++)
+      data.cols.push_back(REAL(dat) + static_cast<std::ptrdiff_t>(c) * data.n_rows);
+  }
+  return data;
+}
+
+} // namespace opa
+
+#endif
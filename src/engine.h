@@ -0,0 +1,423 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Row-level c-value computations used by the native engines. Everything
+ * here operates on raw pointers into R's memory and is safe to call from
+ * worker threads.
+ */
+
+#ifndef OPA_ENGINE_H
+#define OPA_ENGINE_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+#include "kernels.h"
+#include "null_distribution.h"
+
+namespace opa {
+
+/*
+ * A read-only view of a data matrix, held as a pointer to each of its
+ * columns. This describes both an R numeric matrix, stored in column-major
+ * order, and the separate column vectors of a data frame.
+ */
+struct DataMatrix {
+  std::vector<const double*> cols;
+  int n_rows;
+  int n_cols;
+};
+
+/*
+ * A compact index of the observed (non-NA) values of a set of rows of a data
+ * matrix, built once per call on the calling thread and shared read-only by
+ * every worker. Complete rows are recorded only by their count; for rows
+ * with missing values the observed column numbers are stored in compressed
+ * sparse row form, so that cols_[offsets_[i]..offsets_[i + 1]) lists the
+ * observed columns of row i. Rows can then be gathered, and the hypothesis
+ * subset, without testing every value for NA again.
+ */
+class ObservedIndex {
+public:
+  ObservedIndex(const DataMatrix& dat, const int* rows, int n_rows)
+    : dat_(dat), rows_(n_rows), n_observed_(n_rows), offsets_(n_rows + 1, 0) {
+    std::vector<int> observed(dat.n_cols);
+    for (int i = 0; i < n_rows; i++) {
+      rows_[i] = rows ? rows[i] - 1 : i;
+      int n{0};
+      for (int c = 0; c < dat.n_cols; c++)
+        if (!std::isnan(dat.cols[c][rows_[i]]))
+          observed[n++] = c;
+      n_observed_[i] = n;
+      if (n < dat.n_cols)
+        cols_.insert(cols_.end(), observed.begin(), observed.begin() + n);
+      offsets_[i + 1] = cols_.size();
+    }
+  }
+
+  int n_rows() const { return static_cast<int>(rows_.size()); }
+
+  // the number of observed values in row i of the index
+  int n_observed(int i) const { return n_observed_[i]; }
+
+  bool complete(int i) const { return n_observed_[i] == dat_.n_cols; }
+
+  /*
+   * Copy the observed values of row i of the index into values, and the
+   * corresponding hypothesis elements into hs. Returns the number of values
+   * copied.
+   */
+  int gather(int i, const double* h, double* values, double* hs) const {
+    const int r{rows_[i]};
+    if (complete(i)) {
+      for (int c = 0; c < dat_.n_cols; c++)
+        values[c] = dat_.cols[c][r];
+    } else {
+      const int* cols{cols_.data() + offsets_[i]};
+      for (int k = 0; k < n_observed_[i]; k++)
+        values[k] = dat_.cols[cols[k]][r];
+    }
+    return subset(i, h, hs);
+  }
+
+  /*
+   * Copy the hypothesis elements corresponding to the observed values of
+   * row i of the index into hs. Returns the number of elements copied.
+   */
+  int subset(int i, const double* h, double* hs) const {
+    if (complete(i)) {
+      std::copy(h, h + dat_.n_cols, hs);
+    } else {
+      const int* cols{cols_.data() + offsets_[i]};
+      for (int k = 0; k < n_observed_[i]; k++)
+        hs[k] = h[cols[k]];
+    }
+    return n_observed_[i];
+  }
+
+private:
+  const DataMatrix dat_;
+  std::vector<int> rows_;
+  std::vector<int> n_observed_;
+  std::vector<std::size_t> offsets_;
+  std::vector<int> cols_;
+};
+
+/*
+ * Per-thread buffers reused for every row a worker processes. Every buffer is
+ * sized once, for rows of n_cols values, when the scratch space is created,
+ * so processing a row, and scoring its permutations, makes no allocations.
+ * allocations counts the buffers allocated when the scratch space was
+ * created and any later reallocations, as found by track().
+ */
+struct RowScratch {
+  std::vector<double> values;
+  std::vector<double> hs;
+  std::vector<double> sorted;
+  std::vector<std::int32_t> ranks;
+  std::vector<int> h_ord;
+  std::vector<std::int8_t> h_signs;
+  SignBits h_bits;
+  // the values of a permutation visited by rank
+  std::vector<double> permuted;
+  std::vector<std::int32_t> permuted_ranks;
+  // the key of a row, as computed by row_key()
+  std::vector<double> key;
+  long allocations;
+
+  explicit RowScratch(int n_cols)
+    : values(n_cols), hs(n_cols), sorted(n_cols), ranks(n_cols), permuted(n_cols),
+      permuted_ranks(n_cols), allocations(0) {
+    const int max_pairs{n_pairs(n_cols, true)};
+    h_ord.reserve(max_pairs);
+    h_signs.reserve(max_pairs + sign_padding);
+    h_bits.gt.reserve((max_pairs + 63) / 64);
+    h_bits.lt.reserve((max_pairs + 63) / 64);
+    key.reserve(1 + 2 * n_cols);
+    const std::array<std::size_t, 11> c(capacities());
+    allocations = std::count_if(c.begin(), c.end(), [](std::size_t x) { return x > 0; });
+    capacity_ = std::accumulate(c.begin(), c.end(), std::size_t{0});
+  }
+
+  RowScratch(const RowScratch& other)
+    : RowScratch(static_cast<int>(other.values.size())) {}
+
+  // count a reallocation if any buffer has grown since the last call
+  void track() {
+    const std::array<std::size_t, 11> c(capacities());
+    const std::size_t capacity{std::accumulate(c.begin(), c.end(), std::size_t{0})};
+    if (capacity != capacity_) {
+      allocations++;
+      capacity_ = capacity;
+    }
+  }
+
+private:
+  std::array<std::size_t, 11> capacities() const {
+    return {{values.capacity(), hs.capacity(), sorted.capacity(), ranks.capacity(),
+             h_ord.capacity(), h_signs.capacity(), h_bits.gt.capacity(),
+             h_bits.lt.capacity(), permuted.capacity(),
+             permuted_ranks.capacity(), key.capacity()}};
+  }
+
+  std::size_t capacity_;
+};
+
+/*
+ * The c-value counts for a single data row.
+ */
+struct RowCounts {
+  double n_perms;
+  double n_perms_greater_eq;
+};
+
+/*
+ * A sequential stopping rule for stochastic c-values. Every batch
+ * replicates, a Wilson score interval with the given z value is computed for
+ * the row's c-value, and sampling stops once the interval lies entirely on
+ * one side of threshold or its half-width is no greater than precision. A
+ * default constructed rule never stops early.
+ */
+struct StoppingRule {
+  int batch;
+  double threshold;
+  double precision;
+  double z;
+
+  StoppingRule() : batch(0), threshold(0), precision(0), z(0) {}
+  StoppingRule(int batch, double threshold, double precision, double z)
+    : batch(batch), threshold(threshold), precision(precision), z(z) {}
+
+  bool check(int reps) const {
+    return batch > 0 && reps % batch == 0;
+  }
+
+  bool resolved(double n_greater_eq, int reps) const {
+    const double p{n_greater_eq / reps};
+    const double z2{z * z / reps};
+    const double centre{(p + z2 / 2) / (1 + z2)};
+    const double half_width{z / (1 + z2) * std::sqrt(p * (1 - p) / reps + z2 / (4 * reps))};
+    return centre + half_width < threshold || centre - half_width > threshold ||
+           half_width <= precision;
+  }
+};
+
+/*
+ * Exact null distributions shared between threads, keyed by the ordering of
+ * the (possibly NA-subset) hypothesis. Entries are never removed, so
+ * references returned by get() stay valid while the cache exists.
+ */
+class NullDistributionCache {
+public:
+  explicit NullDistributionCache(bool pairwise) : pairwise_(pairwise) {}
+
+  const std::vector<double>& get(const std::vector<int>& h_ord, const double* hs, int n) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::map<std::vector<int>, std::vector<double> >::const_iterator it{cache_.find(h_ord)};
+      if (it != cache_.end())
+        return it->second;
+    }
+    // compute outside the lock; if another thread gets there first its
+    // identical distribution is kept
+    std::vector<double> dist{pairwise_ ? pairwise_null_distribution(hs, n)
+                                       : adjacent_null_distribution(h_ord.data(), n)};
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cache_.insert(std::make_pair(h_ord, dist)).first->second;
+  }
+
+private:
+  bool pairwise_;
+  std::mutex mutex_;
+  std::map<std::vector<int>, std::vector<double> > cache_;
+};
+
+/*
+ * True if the n values contain no repeated value.
+ */
+inline bool all_distinct(const double* values, int n, std::vector<double>& sorted) {
+  sorted.assign(values, values + n);
+  std::sort(sorted.begin(), sorted.end());
+  return std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end();
+}
+
+/*
+ * The hypothesis ordering for row i of index, given its n observed values
+ * and hypothesis elements gathered into s. Complete rows share full_h_ord,
+ * the ordering of the whole hypothesis computed once per call; for other
+ * rows the ordering of the subset hypothesis is computed into s.h_ord.
+ */
+template <typename Pairing>
+const std::vector<int>& row_ordering(const ObservedIndex& index, int i, int n,
+                                     const std::vector<int>& full_h_ord, RowScratch& s) {
+  if (index.complete(i))
+    return full_h_ord;
+  ordering(s.hs.data(), n, Pairing::pairwise, 0, s.h_ord);
+  return s.h_ord;
+}
+
+/*
+ * True if a row whose n observed values have been gathered into s is
+ * scored from a cached null distribution rather than by enumerating its
+ * permutations, which is so for rows without repeated values scored with no
+ * difference threshold.
+ */
+inline bool uses_null_distribution(int n, double diff_threshold, RowScratch& s) {
+  return diff_threshold == 0 && n >= 2 && all_distinct(s.values.data(), n, s.sorted);
+}
+
+/*
+ * Compute into key the key of row i of index under which its exact c-value
+ * counts may be shared with other rows: its number of observed values, the
+ * corresponding hypothesis elements and, with no difference threshold, the
+ * dense ranks of its values, or otherwise the values themselves. Rows with
+ * equal keys have identical permutation distributions, whether or not they
+ * are missing the same columns. Returns a hash of the key. Negative zeros are
+ * stored as zeros so that equal keys have equal hashes.
+ */
+inline std::uint64_t row_key(const ObservedIndex& index, int i, const double* h,
+                             double diff_threshold, RowScratch& s, std::vector<double>& key) {
+  const int n{index.gather(i, h, s.values.data(), s.hs.data())};
+  key.resize(1 + 2 * n);
+  key[0] = n;
+  for (int k = 0; k < n; k++)
+    key[1 + k] = s.hs[k] + 0.0;
+  if (diff_threshold == 0) {
+    encode_ranks(s.values.data(), n, s.ranks.data(), s.sorted);
+    for (int k = 0; k < n; k++)
+      key[1 + n + k] = s.ranks[k];
+  } else {
+    for (int k = 0; k < n; k++)
+      key[1 + n + k] = s.values[k] + 0.0;
+  }
+  // FNV-1a over the hashes of the elements
+  std::uint64_t hash{14695981039346656037ULL};
+  for (std::size_t k = 0; k < key.size(); k++)
+    hash = (hash ^ std::hash<double>()(key[k])) * 1099511628211ULL;
+  return hash;
+}
+
+/*
+ * The number of distinct permutations of the n values gathered into s.
+ */
+inline unsigned long long distinct_permutations(int n, RowScratch& s) {
+  s.sorted.assign(s.values.begin(), s.values.begin() + n);
+  std::sort(s.sorted.begin(), s.sorted.end());
+  return factorial(n) / multiset_weight(s.sorted.data(), n);
+}
+
+/*
+ * The number of rank ranges into which the n_perms distinct permutations of
+ * a row are split when enumerating them, so that the permutations of a
+ * single row can be scored by up to n_workers workers. Each range has at
+ * least min_range_perms permutations, so rows with few permutations, and
+ * every row when there is a single worker, are enumerated whole.
+ */
+const unsigned long long min_range_perms{1ULL << 16};
+
+inline int permutation_ranges(unsigned long long n_perms, int n_workers) {
+  if (n_workers == 1)
+    return 1;
+  const unsigned long long ranges{n_perms / min_range_perms};
+  return static_cast<int>(std::max<unsigned long long>(
+    1, std::min<unsigned long long>(ranges, 8ULL * n_workers)));
+}
+
+/*
+ * Exact c-value counts for row i of index. Rows without repeated values
+ * scored with no difference threshold use a cached null distribution; all
+ * other rows are enumerated in place, as ranks if no difference threshold
+ * is applied. If hist is not null the number of permutations with k correct
+ * pairs is added to hist[k]. If progress is not null the distinct
+ * permutations enumerated are added to it, or 1 for a row scored from a null
+ * distribution, and enumeration stops early if the work is cancelled.
+ */
+template <typename Pairing>
+RowCounts exact_row(const ObservedIndex& index, int i, const double* h,
+                    const std::vector<int>& full_h_ord, double diff_threshold,
+                    NullDistributionCache& cache, RowScratch& s, double* hist,
+                    Progress* progress = nullptr) {
+  const int n{index.gather(i, h, s.values.data(), s.hs.data())};
+  const std::vector<int>& h_ord = row_ordering<Pairing>(index, i, n, full_h_ord, s);
+  RowCounts counts;
+  counts.n_perms = static_cast<double>(factorial(n));
+  if (uses_null_distribution(n, diff_threshold, s)) {
+    const std::vector<double>& dist = cache.get(h_ord, s.hs.data(), n);
+    pack_sign_bits(h_ord.data(), static_cast<int>(h_ord.size()), s.h_bits);
+    const int observed{count_matches<Pairing>(s.values.data(), n, 0, s.h_bits)};
+    counts.n_perms_greater_eq = 0;
+    for (std::size_t k = observed; k < dist.size(); k++)
+      counts.n_perms_greater_eq += dist[k];
+    if (hist)
+      for (std::size_t k = 0; k < dist.size(); k++)
+        hist[k] += dist[k];
+    if (progress)
+      progress->add(1);
+  } else if (diff_threshold == 0) {
+    encode_ranks(s.values.data(), n, s.ranks.data(), s.sorted);
+    counts.n_perms_greater_eq = static_cast<double>(with_rank_scorer<Pairing>(
+      h_ord.data(), n, s.h_signs,
+      PermutationCounts<std::int32_t>{s.ranks.data(), n, hist, progress}));
+  } else {
+    counts.n_perms_greater_eq = static_cast<double>(with_permutation_scorer<Pairing>(
+      h_ord.data(), n, diff_threshold, s.h_bits,
+      PermutationCounts<double>{s.values.data(), n, hist, progress}));
+  }
+  return counts;
+}
+
+/*
+ * The weighted number of distinct permutations of row i of index with
+ * lexicographic ranks in [first, last) with at least as many correct pairs
+ * as the observed row, enumerated as by exact_row(). Summed over ranges
+ * covering every distinct permutation this equals the count exact_row()
+ * computes by enumeration, as do the additions to hist. Progress is reported
+ * as by exact_row().
+ */
+template <typename Pairing>
+unsigned long long exact_row_range(const ObservedIndex& index, int i, const double* h,
+                                   const std::vector<int>& full_h_ord, double diff_threshold,
+                                   unsigned long long first, unsigned long long last,
+                                   RowScratch& s, unsigned long long* hist,
+                                   Progress* progress = nullptr) {
+  const int n{index.gather(i, h, s.values.data(), s.hs.data())};
+  const std::vector<int>& h_ord = row_ordering<Pairing>(index, i, n, full_h_ord, s);
+  if (diff_threshold == 0) {
+    encode_ranks(s.values.data(), n, s.ranks.data(), s.sorted);
+    return with_rank_scorer<Pairing>(
+      h_ord.data(), n, s.h_signs,
+      PermutationRangeCounts<std::int32_t>{s.ranks.data(), n, first, last,
+                                           s.permuted_ranks.data(), hist, progress});
+  }
+  return with_permutation_scorer<Pairing>(
+    h_ord.data(), n, diff_threshold, s.h_bits,
+    PermutationRangeCounts<double>{s.values.data(), n, first, last, s.permuted.data(),
+                                   hist, progress});
+}
+
+} // namespace opa
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Scoring kernels specialised at compile time for rows of a fixed number of
+ * values N. The loops over the pairs of a row are unrolled at compile time,
+ * so that every pair index is a constant, and the hypothesis is held in an
+ * array of fixed size, so that scoring a row involves no loop counters,
+ * dynamically sized buffers or bounds computed at run time. Like kernels.h,
+ * nothing here touches the R API.
+ */
+
+#ifndef OPA_FIXED_KERNELS_H
+#define OPA_FIXED_KERNELS_H
+
+#include <cstdint>
+
+namespace opa {
+
+/*
+ * The largest number of values scored by the fixed kernels, covering the
+ * designs of up to 10 conditions for which the exact and stochastic c-value
+ * loops spend most of their time scoring. Rows of more values are scored by
+ * the generic kernels in kernels.h.
+ */
+const int max_fixed_n{10};
+
+constexpr int fixed_n_pairs(int n, bool pairwise) {
+  return n < 2 ? 0 : pairwise ? ((n - 1) * n) / 2 : n - 1;
+}
+
+// the position of the relation between values i < j in the order of ordering()
+constexpr int fixed_pair_index(int i, int j, int n, bool pairwise) {
+  return pairwise ? i * n - i * (i + 1) / 2 + j - i - 1 : i;
+}
+
+/*
+ * Visits every relation (I, J) of N values in the order of ordering() by
+ * calling f.visit<I, J, P>(), where P is the position of the relation, so
+ * that the loop over pairs is unrolled and every index is a constant.
+ */
+template <bool Pairwise, int N, int I, int J, bool Done = (I + 1 >= N)>
+struct FixedPairs {
+  static const bool last_j = !Pairwise || J + 1 >= N;
+
+  template <typename F>
+  static void apply(F& f) {
+    f.template visit<I, J, fixed_pair_index(I, J, N, Pairwise)>();
+    FixedPairs<Pairwise, N, last_j ? I + 1 : I, last_j ? I + 2 : J + 1>::apply(f);
+  }
+};
+
+template <bool Pairwise, int N, int I, int J>
+struct FixedPairs<Pairwise, N, I, J, true> {
+  template <typename F>
+  static void apply(F&) {}
+};
+
+/*
+ * The sign of a difference conditional on a difference threshold, as
+ * sign_with_threshold(). Ranks are only scored with no difference threshold,
+ * so their signs are compared with a constant 0.
+ */
+inline int fixed_sign(double d, double diff_threshold) {
+  return (d > diff_threshold) - (d < -diff_threshold);
+}
+
+inline int fixed_sign(std::int32_t d, std::int32_t) { return (d > 0) - (d < 0); }
+
+/*
+ * Counts the relations of xs, conditional on diff_threshold, which match the
+ * hypothesis signs in h.
+ */
+template <typename T>
+struct FixedMatches {
+  const T* xs;
+  T diff_threshold;
+  const std::int8_t* h;
+  int correct;
+
+  template <int I, int J, int P>
+  void visit() {
+    const T d{static_cast<T>(xs[J] - xs[I])};
+    correct += fixed_sign(d, diff_threshold) == h[P];
+  }
+};
+
+/*
+ * The number of the relations of the N values of xs, conditional on
+ * diff_threshold, which match the hypothesis signs in h.
+ */
+template <bool Pairwise, int N, typename T>
+inline int fixed_count_matches(const T* xs, T diff_threshold, const std::int8_t* h) {
+  FixedMatches<T> matches{xs, diff_threshold, h, 0};
+  FixedPairs<Pairwise, N, 0, 1>::apply(matches);
+  return matches.correct;
+}
+
+/*
+ * Scores rows of N values, or of N ranks encoded by encode_ranks() when T is
+ * std::int32_t and no difference threshold is applied, against a fixed
+ * hypothesis ordering. Has the interface of PermutationScorer and
+ * RankScorer, so it can be passed to the same enumeration and sampling
+ * loops, but holds the hypothesis signs in an array of their fixed number
+ * rather than in buffers sized at run time.
+ */
+template <typename Pairing, int N, typename T>
+class FixedScorer {
+public:
+  explicit FixedScorer(const int* h_ord, T diff_threshold = 0) : diff_threshold_(diff_threshold) {
+    for (int p = 0; p < n_pairs(); p++)
+      h_signs_[p] = static_cast<std::int8_t>(h_ord[p]);
+  }
+
+  // the number of pairs in xs correctly classified by the hypothesis
+  int correct(const T* xs) const {
+    return fixed_count_matches<Pairing::pairwise, N>(xs, diff_threshold_, h_signs_);
+  }
+
+  int n_pairs() const { return fixed_n_pairs(N, Pairing::pairwise); }
+
+private:
+  T diff_threshold_;
+  std::int8_t h_signs_[fixed_n_pairs(N, Pairing::pairwise)];
+};
+
+/*
+ * Calls f.fixed<N>() with N = n if n is between 2 and max_fixed_n, so that
+ * the number of values of a row is inspected once and the kernels it calls
+ * are specialised for it, and f.generic() otherwise.
+ */
+template <typename F>
+typename F::result_type dispatch_fixed_n(int n, const F& f) {
+  switch (n) {
+  case 2: return f.template fixed<2>();
+  case 3: return f.template fixed<3>();
+  case 4: return f.template fixed<4>();
+  case 5: return f.template fixed<5>();
+  case 6: return f.template fixed<6>();
+  case 7: return f.template fixed<7>();
+  case 8: return f.template fixed<8>();
+  case 9: return f.template fixed<9>();
+  case 10: return f.template fixed<10>();
+  default: return f.generic();
+  }
+}
+
+} // namespace opa
+
+#endif
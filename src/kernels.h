@@ -0,0 +1,815 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Scoring kernels shared by the exported Rcpp functions. Nothing in this
+ * header touches the R API, so the kernels can be called on raw pointers
+ * into R's memory without creating any intermediate R objects.
+ */
+
+#ifndef OPA_KERNELS_H
+#define OPA_KERNELS_H
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fixed_kernels.h"
+#include "progress.h"
+#include "simd.h"
+
+namespace opa {
+
+/*
+ * The sign of a difference conditional on a difference threshold, matching
+ * c_sign_with_threshold() for a single non-missing value.
+ */
+inline int sign_with_threshold(double d, double diff_threshold) {
+  if (d > diff_threshold)
+    return 1;
+  if (d < -diff_threshold)
+    return -1;
+  return 0;
+}
+
+/*
+ * The number of ordinal relations in a row with n non-missing values.
+ */
+inline int n_pairs(int n, bool pairwise) {
+  if (n < 2)
+    return 0;
+  return pairwise ? ((n - 1) * n) / 2 : n - 1;
+}
+
+/*
+ * Convert a count of correctly classified pairs into a PCC. The division is
+ * carried out in long double precision, as R's mean() does for logical
+ * vectors, so that PCCs computed here compare exactly with PCCs computed by
+ * R or by Rcpp sugar.
+ */
+inline double pcc_value(long long correct, long long n) {
+  return static_cast<double>(static_cast<long double>(correct) / n) * 100;
+}
+
+/*
+ * Fill h_ord with the ordinal relations of the n values in h.
+ */
+inline void ordering(const double* h, int n, bool pairwise,
+                     double diff_threshold, std::vector<int>& h_ord) {
+  h_ord.resize(n_pairs(n, pairwise));
+  int p{0};
+  if (pairwise) {
+    for (int i = 0; i < n; i++)
+      for (int j = i + 1; j < n; j++)
+        h_ord[p++] = sign_with_threshold(h[j] - h[i], diff_threshold);
+  } else {
+    for (int i = 0; i + 1 < n; i++)
+      h_ord[p++] = sign_with_threshold(h[i + 1] - h[i], diff_threshold);
+  }
+}
+
+/*
+ * Pack the n_pairs ordinal relations in h_ord into signs as int8, followed
+ * by zero padding so that vector kernels may read a whole block past the
+ * last pair.
+ */
+const int sign_padding{8};
+
+inline void pack_signs(const int* h_ord, int n_pairs, std::vector<std::int8_t>& signs) {
+  signs.assign(n_pairs + sign_padding, 0);
+  for (int p = 0; p < n_pairs; p++)
+    signs[p] = static_cast<std::int8_t>(h_ord[p]);
+}
+
+/*
+ * Encode the n values of xs as dense ranks, so that equal values share a
+ * rank. The sign of the difference between two ranks equals the sign of the
+ * difference between the values, so with no difference threshold a row can
+ * be scored, and permuted, as integers.
+ */
+inline void encode_ranks(const double* xs, int n, std::int32_t* ranks,
+                         std::vector<double>& sorted) {
+  sorted.assign(xs, xs + n);
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  for (int i = 0; i < n; i++)
+    ranks[i] = static_cast<std::int32_t>(
+      std::lower_bound(sorted.begin(), sorted.end(), xs[i]) - sorted.begin());
+}
+
+/*
+ * Pairing type tags used to specialise kernels at compile time, so that the
+ * pairing_type string is only inspected once per call rather than once per
+ * permutation.
+ */
+struct Pairwise {
+  static const bool pairwise = true;
+};
+
+struct Adjacent {
+  static const bool pairwise = false;
+};
+
+/*
+ * An ordering packed as two bitplanes: bit p of gt is set if relation p is
+ * 1, and bit p of lt if it is -1, so each relation takes 2 bits rather than
+ * the 32 of an IntegerVector element.
+ */
+struct SignBits {
+  std::vector<std::uint64_t> gt;
+  std::vector<std::uint64_t> lt;
+};
+
+inline void pack_sign_bits(const int* h_ord, int n_pairs, SignBits& bits) {
+  const std::size_t n_words{static_cast<std::size_t>(n_pairs + 63) / 64};
+  bits.gt.assign(n_words, 0);
+  bits.lt.assign(n_words, 0);
+  for (int p = 0; p < n_pairs; p++) {
+    const std::uint64_t bit{std::uint64_t{1} << (p % 64)};
+    if (h_ord[p] > 0)
+      bits.gt[p / 64] |= bit;
+    else if (h_ord[p] < 0)
+      bits.lt[p / 64] |= bit;
+  }
+}
+
+/*
+ * Accumulates the sign bits of a row's relations, in the order in which
+ * ordering() lists them, and compares each completed 64-bit word with the
+ * hypothesis bitplanes. A relation matches when neither its greater nor its
+ * less bit differs from the hypothesis, so 64 relations are compared with a
+ * few bitwise operations and a popcount.
+ */
+class SignBitMatcher {
+public:
+  explicit SignBitMatcher(const SignBits& h) : h_(h), gt_(0), lt_(0), bit_(0), word_(0), correct_(0) {}
+
+  void push(bool gt, bool lt) {
+    gt_ |= static_cast<std::uint64_t>(gt) << bit_;
+    lt_ |= static_cast<std::uint64_t>(lt) << bit_;
+    if (++bit_ == 64)
+      flush(~std::uint64_t{0});
+  }
+
+  // push k relations at once, if they fit in the current word
+  bool push_block(unsigned gt, unsigned lt, int k) {
+    if (bit_ + k > 64)
+      return false;
+    gt_ |= static_cast<std::uint64_t>(gt) << bit_;
+    lt_ |= static_cast<std::uint64_t>(lt) << bit_;
+    bit_ += k;
+    if (bit_ == 64)
+      flush(~std::uint64_t{0});
+    return true;
+  }
+
+  int correct() {
+    if (bit_ > 0)
+      flush((std::uint64_t{1} << bit_) - 1);
+    return correct_;
+  }
+
+private:
+  void flush(std::uint64_t mask) {
+    const std::uint64_t mismatch{(gt_ ^ h_.gt[word_]) | (lt_ ^ h_.lt[word_])};
+    correct_ += static_cast<int>(std::bitset<64>(~mismatch & mask).count());
+    gt_ = 0;
+    lt_ = 0;
+    bit_ = 0;
+    word_++;
+  }
+
+  const SignBits& h_;
+  std::uint64_t gt_;
+  std::uint64_t lt_;
+  int bit_;
+  std::size_t word_;
+  int correct_;
+};
+
+/*
+ * Count the ordinal relations in the n values of xs which match the
+ * hypothesis ordering packed in h_bits.
+ */
+template <typename Pairing>
+inline int count_matches(const double* xs, int n, double diff_threshold, const SignBits& h_bits);
+
+template <>
+inline int count_matches<Pairwise>(const double* xs, int n, double diff_threshold,
+                                   const SignBits& h_bits) {
+  SignBitMatcher matcher(h_bits);
+  for (int i = 0; i < n; i++) {
+    const double xi{xs[i]};
+    int j{i + 1};
+#if defined(OPA_SIMD_AVX2)
+    for (; j + simd::value_lanes <= n; j += simd::value_lanes) {
+      unsigned gt, lt;
+      simd::value_signs(xi, xs + j, diff_threshold, gt, lt);
+      if (!matcher.push_block(gt, lt, simd::value_lanes))
+        break;
+    }
+#endif
+    for (; j < n; j++) {
+      const double d{xs[j] - xi};
+      matcher.push(d > diff_threshold, d < -diff_threshold);
+    }
+  }
+  return matcher.correct();
+}
+
+template <>
+inline int count_matches<Adjacent>(const double* xs, int n, double diff_threshold,
+                                   const SignBits& h_bits) {
+  SignBitMatcher matcher(h_bits);
+  for (int i = 0; i + 1 < n; i++) {
+    const double d{xs[i + 1] - xs[i]};
+    matcher.push(d > diff_threshold, d < -diff_threshold);
+  }
+  return matcher.correct();
+}
+
+template <typename Pairing>
+struct CountMatches {
+  typedef int result_type;
+  const double* xs;
+  int n;
+  double diff_threshold;
+  const SignBits& h_bits;
+  const std::int8_t* h_signs;
+
+  template <int N>
+  int fixed() const { return fixed_count_matches<Pairing::pairwise, N>(xs, diff_threshold, h_signs); }
+
+  int generic() const { return count_matches<Pairing>(xs, n, diff_threshold, h_bits); }
+};
+
+/*
+ * As count_matches(), choosing the pairing type at run time. Rows of at most
+ * max_fixed_n values are scored by the fixed kernels using the hypothesis
+ * signs packed by pack_signs() in h_signs, and other rows using h_bits.
+ */
+inline int count_matches(const double* xs, int n, bool pairwise, double diff_threshold,
+                         const SignBits& h_bits, const std::int8_t* h_signs) {
+  if (pairwise)
+    return dispatch_fixed_n(n, CountMatches<Pairwise>{xs, n, diff_threshold, h_bits, h_signs});
+  return dispatch_fixed_n(n, CountMatches<Adjacent>{xs, n, diff_threshold, h_bits, h_signs});
+}
+
+/*
+ * Pack the ordinal relations of the n values of xs, conditional on
+ * diff_threshold, into bitplanes like those of a hypothesis, so that one
+ * ordering of a row can be compared with several hypotheses.
+ */
+template <typename Pairing>
+inline void pack_row_bits(const double* xs, int n, double diff_threshold, SignBits& bits) {
+  const int pairs{n_pairs(n, Pairing::pairwise)};
+  const std::size_t n_words{static_cast<std::size_t>(pairs + 63) / 64};
+  bits.gt.assign(n_words, 0);
+  bits.lt.assign(n_words, 0);
+  int p{0};
+  for (int i = 0; i + 1 < n; i++) {
+    const int last{Pairing::pairwise ? n : i + 2};
+    for (int j = i + 1; j < last; j++, p++) {
+      const double d{xs[j] - xs[i]};
+      bits.gt[p / 64] |= static_cast<std::uint64_t>(d > diff_threshold) << (p % 64);
+      bits.lt[p / 64] |= static_cast<std::uint64_t>(d < -diff_threshold) << (p % 64);
+    }
+  }
+}
+
+/*
+ * The number of the n_pairs relations packed in row which match those
+ * packed in h.
+ */
+inline int count_bit_matches(const SignBits& row, const SignBits& h, int n_pairs) {
+  int correct{0};
+  for (std::size_t w = 0; w < row.gt.size(); w++) {
+    const int bits{std::min(64, n_pairs - static_cast<int>(w) * 64)};
+    const std::uint64_t mask{bits == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << bits) - 1};
+    const std::uint64_t mismatch{(row.gt[w] ^ h.gt[w]) | (row.lt[w] ^ h.lt[w])};
+    correct += static_cast<int>(std::bitset<64>(~mismatch & mask).count());
+  }
+  return correct;
+}
+
+/*
+ * Count the ordinal relations in the n ranks which match the hypothesis sign
+ * pattern h_signs. Equivalent to count_matches() on the values the ranks
+ * encode with no difference threshold.
+ */
+template <typename Pairing>
+inline int count_rank_matches(const std::int32_t* ranks, int n, const std::int8_t* h_signs);
+
+template <>
+inline int count_rank_matches<Pairwise>(const std::int32_t* ranks, int n,
+                                        const std::int8_t* h_signs) {
+  int correct{0};
+  int p{0};
+  for (int i = 0; i < n; i++) {
+    const std::int32_t ri{ranks[i]};
+    int j{i + 1};
+#if OPA_SIMD_LANES > 0
+    for (; j + OPA_SIMD_LANES <= n; j += OPA_SIMD_LANES, p += OPA_SIMD_LANES)
+      correct += simd::rank_matches(ri, ranks + j, h_signs + p);
+#endif
+    for (; j < n; j++)
+      correct += (ranks[j] > ri) - (ranks[j] < ri) == h_signs[p++];
+  }
+  return correct;
+}
+
+template <>
+inline int count_rank_matches<Adjacent>(const std::int32_t* ranks, int n,
+                                        const std::int8_t* h_signs) {
+  int correct{0};
+  int i{0};
+#if OPA_SIMD_LANES > 0
+  for (; i + OPA_SIMD_LANES < n; i += OPA_SIMD_LANES)
+    correct += simd::rank_matches(ranks + i, ranks + i + 1, h_signs + i);
+#endif
+  for (; i + 1 < n; i++)
+    correct += (ranks[i + 1] > ranks[i]) - (ranks[i + 1] < ranks[i]) == h_signs[i];
+  return correct;
+}
+
+/*
+ * Scores permutations of a single data row against a fixed hypothesis
+ * ordering. The hypothesis ordering is packed once into bitplanes, which are
+ * then reused for every permutation scored. The bitplanes are owned by the
+ * scorer, or packed into a caller's buffer, typically a worker's scratch
+ * space, so that constructing a scorer for each row does not allocate.
+ */
+template <typename Pairing>
+class PermutationScorer {
+public:
+  PermutationScorer(const int* h_ord, int n, double diff_threshold)
+    : PermutationScorer(h_ord, n, diff_threshold, own_bits_) {}
+
+  PermutationScorer(const int* h_ord, int n, double diff_threshold, SignBits& bits)
+    : h_bits_(&bits),
+      n_(n),
+      n_pairs_(opa::n_pairs(n, Pairing::pairwise)),
+      diff_threshold_(diff_threshold) {
+    pack_sign_bits(h_ord, n_pairs_, bits);
+  }
+
+  // h_bits_ may refer to own_bits_, so scorers are not copied
+  PermutationScorer(const PermutationScorer&) = delete;
+  PermutationScorer& operator=(const PermutationScorer&) = delete;
+
+  // the number of pairs in xs correctly classified by the hypothesis
+  int correct(const double* xs) const {
+    return count_matches<Pairing>(xs, n_, diff_threshold_, *h_bits_);
+  }
+
+  int n_pairs() const { return n_pairs_; }
+
+private:
+  SignBits own_bits_;
+  const SignBits* h_bits_;
+  int n_;
+  int n_pairs_;
+  double diff_threshold_;
+};
+
+/*
+ * Scores permutations of a data row encoded by encode_ranks(), for use when
+ * no difference threshold is applied. As for PermutationScorer the packed
+ * hypothesis signs are owned by the scorer or held in a caller's buffer.
+ */
+template <typename Pairing>
+class RankScorer {
+public:
+  RankScorer(const int* h_ord, int n) : RankScorer(h_ord, n, own_signs_) {}
+
+  RankScorer(const int* h_ord, int n, std::vector<std::int8_t>& signs)
+    : n_(n),
+      n_pairs_(opa::n_pairs(n, Pairing::pairwise)) {
+    pack_signs(h_ord, n_pairs_, signs);
+    h_signs_ = signs.data();
+  }
+
+  // h_signs_ may point into own_signs_, so scorers are not copied
+  RankScorer(const RankScorer&) = delete;
+  RankScorer& operator=(const RankScorer&) = delete;
+
+  // the number of pairs in ranks correctly classified by the hypothesis
+  int correct(const std::int32_t* ranks) const {
+    return count_rank_matches<Pairing>(ranks, n_, h_signs_);
+  }
+
+  int n_pairs() const { return n_pairs_; }
+
+private:
+  std::vector<std::int8_t> own_signs_;
+  const std::int8_t* h_signs_;
+  int n_;
+  int n_pairs_;
+};
+
+/*
+ * Call f with a scorer of rows of n values against the hypothesis ordering
+ * h_ord: a FixedScorer if n is at most max_fixed_n, or else a
+ * PermutationScorer packing the hypothesis into bits. f is a function object
+ * taking any scorer and defining its result_type.
+ */
+template <typename Pairing, typename F>
+struct PermutationScorerDispatch {
+  typedef typename F::result_type result_type;
+  const int* h_ord;
+  int n;
+  double diff_threshold;
+  SignBits& bits;
+  const F& f;
+
+  template <int N>
+  result_type fixed() const { return f(FixedScorer<Pairing, N, double>(h_ord, diff_threshold)); }
+
+  result_type generic() const {
+    return f(PermutationScorer<Pairing>(h_ord, n, diff_threshold, bits));
+  }
+};
+
+template <typename Pairing, typename F>
+typename F::result_type with_permutation_scorer(const int* h_ord, int n, double diff_threshold,
+                                                SignBits& bits, const F& f) {
+  return dispatch_fixed_n(n, PermutationScorerDispatch<Pairing, F>{h_ord, n, diff_threshold, bits, f});
+}
+
+/*
+ * As with_permutation_scorer(), for rows encoded by encode_ranks(), with a
+ * RankScorer packing the hypothesis into signs for rows of more than
+ * max_fixed_n values.
+ */
+template <typename Pairing, typename F>
+struct RankScorerDispatch {
+  typedef typename F::result_type result_type;
+  const int* h_ord;
+  int n;
+  std::vector<std::int8_t>& signs;
+  const F& f;
+
+  template <int N>
+  result_type fixed() const { return f(FixedScorer<Pairing, N, std::int32_t>(h_ord)); }
+
+  result_type generic() const { return f(RankScorer<Pairing>(h_ord, n, signs)); }
+};
+
+template <typename Pairing, typename F>
+typename F::result_type with_rank_scorer(const int* h_ord, int n,
+                                         std::vector<std::int8_t>& signs, const F& f) {
+  return dispatch_fixed_n(n, RankScorerDispatch<Pairing, F>{h_ord, n, signs, f});
+}
+
+/*
+ * Score n_perms permutations stored contiguously, one permutation of n
+ * values after another, as in the columns of an R matrix. Writes the PCC of
+ * each permutation to perm_pccs and returns the number of permutations with
+ * a PCC at least as great as obs_pcc.
+ */
+struct PermutationMatrixScores {
+  typedef int result_type;
+  const double* perms;
+  int n;
+  int n_perms;
+  double obs_pcc;
+  double* perm_pccs;
+
+  template <typename Scorer>
+  int operator()(const Scorer& scorer) const {
+    const int pairs{scorer.n_pairs()};
+    int n_perms_greater_eq{0};
+    for (int i = 0; i < n_perms; i++) {
+      const double* column{perms + static_cast<std::ptrdiff_t>(i) * n};
+      perm_pccs[i] = pcc_value(scorer.correct(column), pairs);
+      if (perm_pccs[i] >= obs_pcc)
+        n_perms_greater_eq++;
+    }
+    return n_perms_greater_eq;
+  }
+};
+
+template <typename Pairing>
+int score_permutations(const double* perms, int n, int n_perms, double diff_threshold,
+                       const int* h_ord, double obs_pcc, double* perm_pccs) {
+  SignBits bits;
+  return with_permutation_scorer<Pairing>(
+    h_ord, n, diff_threshold, bits, PermutationMatrixScores{perms, n, n_perms, obs_pcc, perm_pccs});
+}
+
+/*
+ * The largest number of values for which n! fits in an unsigned 64-bit
+ * integer, and therefore the largest row that can be enumerated exactly.
+ */
+const int max_exact_n{20};
+
+inline unsigned long long factorial(int n) {
+  unsigned long long f{1};
+  for (int i = 2; i <= n; i++)
+    f *= i;
+  return f;
+}
+
+/*
+ * The product of the factorials of the multiplicities of the distinct values
+ * among the n values in sorted, which are in ascending order. Each distinct
+ * permutation of the values is produced by this many of the n! permutations
+ * of their positions, so there are n! divided by this many distinct
+ * permutations.
+ */
+template <typename T>
+inline unsigned long long multiset_weight(const T* sorted, int n) {
+  unsigned long long weight{1};
+  int run{1};
+  for (int i = 1; i < n; i++) {
+    run = sorted[i] == sorted[i - 1] ? run + 1 : 1;
+    weight *= run;
+  }
+  return weight;
+}
+
+/*
+ * Score every distinct permutation of the n values (or ranks) in v, visiting
+ * them in place with std::next_permutation so that no permutation matrix is
+ * ever built. The observed number of correct pairs is that of v as given;
+ * v is then sorted and its distinct permutations visited in lexicographic
+ * order, ending with v sorted. Each distinct permutation is weighted by
+ * multiset_weight(), the number of the n! permutations of positions which
+ * produce it, so repeated values are counted exactly as in the n! columns of
+ * c_generate_permutations() while a row with ties is scored only once per
+ * distinct ordering. If hist is not null, hist[k] is incremented by the
+ * weight of every permutation with k correct pairs. Returns the weighted
+ * number of permutations with at least as many correct pairs as the observed
+ * data. A row with fewer than two values has no pairs and an undefined PCC,
+ * which no permutation is counted as matching. If progress is not null each
+ * distinct permutation visited is added to it, and enumeration stops early,
+ * with incomplete counts, if the work is cancelled.
+ */
+template <typename T, typename Scorer>
+unsigned long long enumerate_permutations(T* v, int n, const Scorer& scorer, double* hist,
+                                          Progress* progress = nullptr) {
+  const int obs_correct{scorer.correct(v)};
+  std::sort(v, v + n);
+  const unsigned long long weight{multiset_weight(v, n)};
+  unsigned long long n_perms_greater_eq{0};
+  ProgressTicker ticker(progress);
+  do {
+    const int correct{scorer.correct(v)};
+    if (correct >= obs_correct && scorer.n_pairs() > 0)
+      n_perms_greater_eq += weight;
+    if (hist)
+      hist[correct] += weight;
+    if (!ticker.tick())
+      break;
+  } while (std::next_permutation(v, v + n));
+  return n_perms_greater_eq;
+}
+
+/*
+ * Set w to the distinct permutation with lexicographic rank r among the
+ * distinct permutations of the n values in sorted, which are in ascending
+ * order, in [0, n! / multiset_weight()). At each position the distinct
+ * remaining values are tried in ascending order, skipping the distinct
+ * permutations of the other remaining values that follow each. w may be
+ * sorted itself.
+ */
+template <typename T>
+inline void unrank_permutation(unsigned long long r, const T* sorted, int n, T* w) {
+  T remaining[max_exact_n];
+  std::copy(sorted, sorted + n, remaining);
+  for (int i = 0; i < n; i++) {
+    const int m{n - i};
+    const unsigned long long weight{multiset_weight(remaining, m)};
+    int j{0};
+    while (j < m) {
+      int run{1};
+      while (j + run < m && remaining[j + run] == remaining[j])
+        run++;
+      // placing remaining[j] divides the weight of the remaining values by run
+      const unsigned long long following{factorial(m - 1) / (weight / run)};
+      if (r < following)
+        break;
+      r -= following;
+      j += run;
+    }
+    w[i] = remaining[j];
+    std::copy(remaining + j + 1, remaining + m, remaining + j);
+  }
+}
+
+/*
+ * Score the distinct permutations of the n values (or ranks) in v with
+ * lexicographic ranks in [first, last), so that the distinct permutations of
+ * a row can be split into ranges scored independently, in parallel or in
+ * separate calls. The permutations are visited in w; v is not modified. Over
+ * all ranks the weighted counts, and the additions to hist, equal those of
+ * enumerate_permutations(), counted over the range only, and progress is
+ * reported in the same way. hist holds integer counts, so that the ranges of
+ * a row can be summed exactly however many there are.
+ */
+template <typename T, typename Scorer>
+unsigned long long enumerate_permutation_range(const T* v, int n, const Scorer& scorer,
+                                               unsigned long long first,
+                                               unsigned long long last, T* w,
+                                               unsigned long long* hist,
+                                               Progress* progress = nullptr) {
+  const int obs_correct{scorer.correct(v)};
+  std::copy(v, v + n, w);
+  std::sort(w, w + n);
+  const unsigned long long weight{multiset_weight(w, n)};
+  unsigned long long n_perms_greater_eq{0};
+  unrank_permutation(first, w, n, w);
+  ProgressTicker ticker(progress);
+  for (unsigned long long m = first; m < last; m++) {
+    if (m > first)
+      std::next_permutation(w, w + n);
+    const int correct{scorer.correct(w)};
+    if (correct >= obs_correct && scorer.n_pairs() > 0)
+      n_perms_greater_eq += weight;
+    if (hist)
+      hist[correct] += weight;
+    if (!ticker.tick())
+      break;
+  }
+  return n_perms_greater_eq;
+}
+
+/*
+ * Function objects enumerating the permutations of a row with a scorer
+ * chosen by with_permutation_scorer() or with_rank_scorer(), as
+ * enumerate_permutations() and enumerate_permutation_range().
+ */
+template <typename T>
+struct PermutationCounts {
+  typedef unsigned long long result_type;
+  T* v;
+  int n;
+  double* hist;
+  Progress* progress;
+
+  template <typename Scorer>
+  unsigned long long operator()(const Scorer& scorer) const {
+    return enumerate_permutations(v, n, scorer, hist, progress);
+  }
+};
+
+template <typename T>
+struct PermutationRangeCounts {
+  typedef unsigned long long result_type;
+  const T* v;
+  int n;
+  unsigned long long first;
+  unsigned long long last;
+  T* w;
+  unsigned long long* hist;
+  Progress* progress;
+
+  template <typename Scorer>
+  unsigned long long operator()(const Scorer& scorer) const {
+    return enumerate_permutation_range(v, n, scorer, first, last, w, hist, progress);
+  }
+};
+
+/*
+ * Count the ordinal relations in the n values of xs which match the
+ * ordinal relations of the n hypothesis values in hs, deriving the
+ * hypothesis ordering on the fly. The diff_threshold is never applied to
+ * the hypothesis.
+ */
+inline int count_matches_hypothesis(const double* xs, const double* hs, int n,
+                                    bool pairwise, double diff_threshold) {
+  int correct{0};
+  if (pairwise) {
+    for (int i = 0; i < n; i++)
+      for (int j = i + 1; j < n; j++)
+        correct += sign_with_threshold(xs[j] - xs[i], diff_threshold) ==
+          sign_with_threshold(hs[j] - hs[i], 0);
+  } else {
+    for (int i = 0; i + 1 < n; i++)
+      correct += sign_with_threshold(xs[i + 1] - xs[i], diff_threshold) ==
+        sign_with_threshold(hs[i + 1] - hs[i], 0);
+  }
+  return correct;
+}
+
+/*
+ * Count the ordinal relations in the n values of xs which match the
+ * hypothesis relations in h_ord at each of n_thresholds difference
+ * thresholds, given in ascending order. A relation the hypothesis predicts
+ * to be a tie matches at every threshold of at least its absolute
+ * difference, and any other relation in the predicted direction matches at
+ * every threshold below its absolute difference. The absolute differences of
+ * the two kinds of relation are sorted once and the matches at every
+ * threshold are counted in a single merge, so counts[k] is the number
+ * count_matches() would return with diff_threshold thresholds[k]. tied and
+ * directed are scratch buffers.
+ */
+inline void count_matches_sweep(const double* xs, int n, bool pairwise, const int* h_ord,
+                                const double* thresholds, int n_thresholds, int* counts,
+                                std::vector<double>& tied, std::vector<double>& directed) {
+  tied.clear();
+  directed.clear();
+  int p{0};
+  for (int i = 0; i + 1 < n; i++) {
+    const int last{pairwise ? n : i + 2};
+    for (int j = i + 1; j < last; j++, p++) {
+      const double d{xs[j] - xs[i]};
+      if (h_ord[p] == 0)
+        tied.push_back(std::fabs(d));
+      else if (h_ord[p] * d > 0)
+        directed.push_back(std::fabs(d));
+    }
+  }
+  std::sort(tied.begin(), tied.end());
+  std::sort(directed.begin(), directed.end());
+  std::size_t n_tied{0};
+  std::size_t n_directed_within{0};
+  for (int k = 0; k < n_thresholds; k++) {
+    const double t{thresholds[k]};
+    while (n_tied < tied.size() && tied[n_tied] <= t)
+      n_tied++;
+    while (n_directed_within < directed.size() && directed[n_directed_within] <= t)
+      n_directed_within++;
+    counts[k] = static_cast<int>(n_tied + directed.size() - n_directed_within);
+  }
+}
+
+/*
+ * The rows of a data matrix processed together by pair_columns(), small
+ * enough that the block of every column stays in cache while each of the
+ * pairs of columns reads it.
+ */
+const std::size_t pair_block_rows{1024};
+
+/*
+ * Fill out, a column-major matrix of n_rows rows and one column per ordinal
+ * relation of n_cols values, with f(x_i, x_j) for every row, where x_i and
+ * x_j are the values of the columns of each pair in the order of
+ * ordering(). Rows are processed in blocks of pair_block_rows so that each
+ * block of the columns is read from cache by every pair it belongs to, and
+ * the inner loop over the rows of a block has no dependencies between
+ * iterations, so that it can be vectorized.
+ */
+template <typename T, typename F>
+inline void pair_columns(const double* const* cols, int n_cols, std::size_t n_rows,
+                         bool pairwise, T* out, F f) {
+  for (std::size_t begin = 0; begin < n_rows; begin += pair_block_rows) {
+    const std::size_t end{std::min(begin + pair_block_rows, n_rows)};
+    T* column{out};
+    for (int i = 0; i + 1 < n_cols; i++) {
+      const int last{pairwise ? n_cols : i + 2};
+      for (int j = i + 1; j < last; j++, column += n_rows) {
+        const double* xi{cols[i]};
+        const double* xj{cols[j]};
+        for (std::size_t r = begin; r < end; r++)
+          column[r] = f(xi[r], xj[r]);
+      }
+    }
+  }
+}
+
+/*
+ * The differences x_j - x_i of every ordinal relation of every row of a
+ * data matrix, as c_all_diffs() or diff() for each row. Missing values
+ * propagate as in R's arithmetic.
+ */
+inline void diff_columns(const double* const* cols, int n_cols, std::size_t n_rows,
+                         bool pairwise, double* out) {
+  pair_columns(cols, n_cols, n_rows, pairwise, out,
+               [](double xi, double xj) { return xj - xi; });
+}
+
+/*
+ * The ordinal relations of every row of a data matrix conditional on a
+ * difference threshold, as c_ordering() for each row. Relations involving a
+ * missing value are set to na.
+ */
+inline void ordering_columns(const double* const* cols, int n_cols, std::size_t n_rows,
+                             bool pairwise, double diff_threshold, int na, int* out) {
+  pair_columns(cols, n_cols, n_rows, pairwise, out, [=](double xi, double xj) {
+    const double d{xj - xi};
+    return std::isnan(d) ? na : (d > diff_threshold) - (d < -diff_threshold);
+  });
+}
+
+} // namespace opa
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Exact permutation distributions of the number of correctly classified
+ * pairs. When a data row contains no repeated values and no difference
+ * threshold is applied, every permutation of the row has the rank pattern
+ * of a permutation of 1..n, so the distribution of correct pairs over all
+ * n! permutations depends only on n, the pairing type and the hypothesis.
+ * It can then be computed by dynamic programming instead of enumeration.
+ */
+
+#ifndef OPA_NULL_DISTRIBUTION_H
+#define OPA_NULL_DISTRIBUTION_H
+
+#include <algorithm>
+#include <vector>
+
+namespace opa {
+
+/*
+ * Multiply the polynomial poly by the Gaussian binomial coefficient
+ * [a + b choose b]_q, whose coefficient of q^k is the number of words of a
+ * zeros and b ones with k inversions.
+ */
+inline void multiply_gaussian_binomial(std::vector<double>& poly, int a, int b) {
+  // c[j] holds the coefficients of [i + j choose j]_q as i increases
+  std::vector<std::vector<double> > c(b + 1);
+  for (int j = 0; j <= b; j++)
+    c[j].assign(1, 1);
+  for (int i = 1; i <= a; i++) {
+    // [i + j choose j] = [i + j - 1 choose j - 1] + q^j [i - 1 + j choose j]
+    for (int j = 1; j <= b; j++) {
+      std::vector<double> next(std::max(c[j - 1].size(), c[j].size() + j), 0);
+      for (std::size_t k = 0; k < c[j - 1].size(); k++)
+        next[k] += c[j - 1][k];
+      for (std::size_t k = 0; k < c[j].size(); k++)
+        next[k + j] += c[j][k];
+      c[j].swap(next);
+    }
+  }
+  const std::vector<double>& g = c[b];
+  std::vector<double> product(poly.size() + g.size() - 1, 0);
+  for (std::size_t i = 0; i < poly.size(); i++)
+    for (std::size_t k = 0; k < g.size(); k++)
+      product[i + k] += poly[i] * g[k];
+  poly.swap(product);
+}
+
+/*
+ * The distribution of correct pairs over all n! permutations of a row of n
+ * distinct values for the "pairwise" pairing type. A pair of conditions
+ * whose hypothesis values are tied can never be matched, and a pair with
+ * distinct hypothesis values is matched when the data are ordered the same
+ * way. Reading the hypothesis tie groups in the rank order of the data gives
+ * a uniformly distributed word over the groups, in which correct pairs are
+ * non-inversions, so the distribution is the q-multinomial coefficient of
+ * the group sizes with each word weighted by the product of the factorials
+ * of the group sizes.
+ * param: h, the n hypothesis values.
+ * return: element k is the number of permutations with k correct pairs.
+ */
+inline std::vector<double> pairwise_null_distribution(const double* h, int n) {
+  std::vector<double> sorted(h, h + n);
+  std::sort(sorted.begin(), sorted.end());
+  std::vector<double> dist(1, 1);
+  int m{0};
+  double weight{1};
+  for (int i = 0; i < n;) {
+    int size{1};
+    while (i + size < n && sorted[i + size] == sorted[i])
+      size++;
+    multiply_gaussian_binomial(dist, m, size);
+    for (int k = 2; k <= size; k++)
+      weight *= k;
+    m += size;
+    i += size;
+  }
+  // pairs within tie groups are never matched but still count as pairs
+  dist.resize(n < 2 ? 1 : (n * (n - 1)) / 2 + 1, 0);
+  for (std::size_t k = 0; k < dist.size(); k++)
+    dist[k] *= weight;
+  return dist;
+}
+
+/*
+ * The distribution of correct pairs over all n! permutations of a row of n
+ * distinct values for the "adjacent" pairing type. Permutations are built
+ * one element at a time, tracking the rank of the last element among those
+ * placed so far and the number of adjacent pairs matched.
+ * param: h_ord, the n - 1 adjacent ordinal relations of the hypothesis.
+ * return: element k is the number of permutations with k correct pairs.
+ */
+inline std::vector<double> adjacent_null_distribution(const int* h_ord, int n) {
+  const int pairs{n < 2 ? 0 : n - 1};
+  // f[j * (pairs + 1) + m]: permutations of the first i elements in which
+  // the last element has rank j and m adjacent pairs are matched
+  std::vector<double> f(static_cast<std::size_t>(std::max(n, 1)) * (pairs + 1), 0);
+  std::vector<double> next(f.size(), 0);
+  std::vector<double> below(pairs + 1);
+  std::vector<double> all(pairs + 1);
+  f[0] = 1;
+  for (int i = 1; i < n; i++) {
+    const int h{h_ord[i - 1]};
+    std::fill(next.begin(), next.end(), 0);
+    std::fill(all.begin(), all.end(), 0);
+    for (int j = 0; j < i; j++)
+      for (int m = 0; m <= pairs; m++)
+        all[m] += f[j * (pairs + 1) + m];
+    std::fill(below.begin(), below.end(), 0);
+    // the new element has rank r among the first i + 1 elements, so the
+    // pair is ascending when the previous element had rank j < r
+    for (int r = 0; r <= i; r++) {
+      for (int m = 0; m <= pairs; m++) {
+        const double ascending{below[m]};
+        const double descending{all[m] - below[m]};
+        double* out{&next[r * (pairs + 1)]};
+        if (h == 1) {
+          if (m < pairs) out[m + 1] += ascending;
+          out[m] += descending;
+        } else if (h == -1) {
+          out[m] += ascending;
+          if (m < pairs) out[m + 1] += descending;
+        } else {
+          out[m] += ascending + descending;
+        }
+      }
+      if (r < i)
+        for (int m = 0; m <= pairs; m++)
+          below[m] += f[r * (pairs + 1) + m];
+    }
+    f.swap(next);
+  }
+  std::vector<double> dist(pairs + 1, 0);
+  for (int j = 0; j < std::max(n, 1); j++)
+    for (int m = 0; m <= pairs; m++)
+      dist[m] += f[j * (pairs + 1) + m];
+  return dist;
+}
+
+} // namespace opa
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Progress reporting and cancellation of long native loops. Workers count
+ * their work locally and add it to a shared atomic counter in batches, so
+ * reporting progress costs an increment per permutation and an atomic
+ * addition per batch, and workers are never serialized.
+ */
+
+#ifndef OPA_PROGRESS_H
+#define OPA_PROGRESS_H
+
+#include <atomic>
+
+namespace opa {
+
+/*
+ * The units of work, typically permutations, a worker completes before
+ * adding them to a Progress and checking whether the work was cancelled.
+ */
+const unsigned long long progress_batch{1 << 16};
+
+/*
+ * The work completed by a set of workers, read by the calling thread while
+ * they run, and whether the work has been cancelled.
+ */
+class Progress {
+public:
+  Progress() : done_(0), cancelled_(false) {}
+
+  void add(unsigned long long n) { done_.fetch_add(n, std::memory_order_relaxed); }
+
+  unsigned long long done() const { return done_.load(std::memory_order_relaxed); }
+
+  void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+
+  bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<unsigned long long> done_;
+  std::atomic<bool> cancelled_;
+};
+
+/*
+ * A worker's count of the work it has completed but not yet added to a
+ * Progress, which may be null if progress is not reported. The count is
+ * added once a batch is complete, and when the ticker is destroyed.
+ */
+class ProgressTicker {
+public:
+  explicit ProgressTicker(Progress* progress) : progress_(progress), pending_(0) {}
+
+  ~ProgressTicker() { flush(); }
+
+  ProgressTicker(const ProgressTicker&) = delete;
+  ProgressTicker& operator=(const ProgressTicker&) = delete;
+
+  // count n units of work, returning false if the work has been cancelled
+  bool tick(unsigned long long n = 1) {
+    if (!progress_)
+      return true;
+    pending_ += n;
+    if (pending_ < progress_batch)
+      return true;
+    flush();
+    return !progress_->cancelled();
+  }
+
+  void flush() {
+    if (progress_ && pending_ > 0)
+      progress_->add(pending_);
+    pending_ = 0;
+  }
+
+private:
+  Progress* progress_;
+  unsigned long long pending_;
+};
+
+} // namespace opa
+
+#endif
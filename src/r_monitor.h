@@ -0,0 +1,87 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Progress bars and user interrupts of the native c-value engines, which
+ * use the R API, unlike the R-independent kernels in the other headers.
+ */
+
+#ifndef OPA_R_MONITOR_H
+#define OPA_R_MONITOR_H
+
+#include <algorithm>
+#include <string>
+#include <Rcpp.h>
+#include "threads.h"
+
+/*
+ * Polls R for a user interrupt from the calling thread while native workers
+ * run, and draws a progress bar like that of txtProgressBar(style = 3) if
+ * show is true, of the progress made towards the total set by set_total().
+ * R_CheckUserInterrupt() is called through R_ToplevelExec() so that an
+ * interrupt returns here, rather than unwinding past the running workers;
+ * once they have stopped, finish() raises it in R.
+ */
+class RMonitor : public opa::Monitor {
+public:
+  explicit RMonitor(bool show) : show_(show), total_(0), drawn_(-1), interrupted_(false) {}
+
+  void set_total(double total) { total_ = total; }
+
+  bool poll() override {
+    if (show_)
+      draw(total_ > 0 ? progress.done() / total_ : 0);
+    if (!interrupted_ && R_ToplevelExec(check_interrupt, nullptr) == FALSE)
+      interrupted_ = true;
+    return !interrupted_;
+  }
+
+  bool interrupted() const { return interrupted_; }
+
+  // complete the progress bar, or raise the interrupt in R
+  void finish() {
+    if (interrupted_)
+      throw Rcpp::internal::InterruptedException();
+    if (show_) {
+      draw(1);
+      Rprintf("\n");
+    }
+  }
+
+private:
+  static void check_interrupt(void*) { R_CheckUserInterrupt(); }
+
+  void draw(double fraction) {
+    const int percent{static_cast<int>(100 * std::min(std::max(fraction, 0.0), 1.0))};
+    if (percent == drawn_)
+      return;
+    drawn_ = percent;
+    const int width{60};
+    const int filled{percent * width / 100};
+    Rprintf("\r  |%s%s| %3d%%", std::string(filled, '=').c_str(),
+            std::string(width - filled, ' ').c_str(), percent);
+    R_FlushConsole();
+  }
+
+  bool show_;
+  double total_;
+  int drawn_;
+  bool interrupted_;
+};
+
+#endif
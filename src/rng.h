@@ -0,0 +1,112 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A random number generator for the native engines which, unlike R's
+ * generator, can be used from worker threads. A single 64-bit seed drawn
+ * from R's generator selects a family of independent streams, and each
+ * individual draws from the stream numbered by its row, so a given
+ * set.seed() produces the same random reorderings whatever the number of
+ * threads and whichever thread processes the row.
+ */
+
+#ifndef OPA_RNG_H
+#define OPA_RNG_H
+
+#include <cstdint>
+#include <utility>
+
+namespace opa {
+
+inline std::uint64_t splitmix64(std::uint64_t& state) {
+  std::uint64_t z{state += 0x9E3779B97F4A7C15ULL};
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/*
+ * xoshiro256** (Blackman & Vigna, 2018). The state of stream k of a seed is
+ * initialised by passing the seed, mixed with a hash of k, through
+ * splitmix64, as recommended by the authors.
+ */
+class Xoshiro256 {
+public:
+  Xoshiro256(std::uint64_t seed, std::uint64_t stream) {
+    std::uint64_t key{stream};
+    std::uint64_t state{seed ^ splitmix64(key)};
+    for (int i = 0; i < 4; i++)
+      s_[i] = splitmix64(state);
+  }
+
+  std::uint64_t next() {
+    const std::uint64_t result{rotl(s_[1] * 5, 7) * 9};
+    const std::uint64_t t{s_[1] << 17};
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = rotl(s_[3], 45);
+    return result;
+  }
+
+  /*
+   * A uniformly distributed integer in [0, range), using Lemire's
+   * multiply-and-reject method so that no value is favoured.
+   */
+  std::uint32_t bounded(std::uint32_t range) {
+    std::uint64_t m{(next() >> 32) * range};
+    std::uint32_t low{static_cast<std::uint32_t>(m)};
+    if (low < range) {
+      const std::uint32_t threshold{static_cast<std::uint32_t>(-range) % range};
+      while (low < threshold) {
+        m = (next() >> 32) * range;
+        low = static_cast<std::uint32_t>(m);
+      }
+    }
+    return static_cast<std::uint32_t>(m >> 32);
+  }
+
+private:
+  static std::uint64_t rotl(std::uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  std::uint64_t s_[4];
+};
+
+/*
+ * Shuffle the n values of v in place (Fisher-Yates).
+ */
+template <typename T>
+inline void shuffle(T* v, int n, Xoshiro256& rng) {
+  for (int i = n - 1; i > 0; i--)
+    std::swap(v[i], v[rng.bounded(static_cast<std::uint32_t>(i) + 1)]);
+}
+
+/*
+ * Combine two integers in [0, 2^32), as drawn in R, into a 64-bit seed.
+ */
+inline std::uint64_t make_seed(double high, double low) {
+  return (static_cast<std::uint64_t>(high) << 32) | static_cast<std::uint64_t>(low);
+}
+
+} // namespace opa
+
+#endif
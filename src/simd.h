@@ -0,0 +1,115 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Vector kernels for the innermost comparison loops. The rank kernels
+ * compare a block of rank differences with the corresponding block of a
+ * hypothesis sign pattern, packed as int8, and return the number of matching
+ * signs; the value kernel computes the sign bits of a block of differences
+ * for the bitplane kernels in kernels.h. The kernels are only compiled when
+ * the compiler targets AVX2 or AArch64 NEON, for example with -march=native
+ * in ~/.R/Makevars; otherwise OPA_SIMD_LANES is 0 and the scalar loops in
+ * kernels.h are used alone.
+ */
+
+#ifndef OPA_SIMD_H
+#define OPA_SIMD_H
+
+#include <bitset>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OPA_SIMD_AVX2
+#define OPA_SIMD_LANES 8
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define OPA_SIMD_NEON
+#define OPA_SIMD_LANES 4
+#else
+#define OPA_SIMD_LANES 0
+#endif
+
+namespace opa {
+namespace simd {
+
+#if defined(OPA_SIMD_AVX2)
+
+/*
+ * The number of the 8 ranks in b[0..7] whose sign relative to a[0..7]
+ * matches h[0..7].
+ */
+inline int rank_matches(__m256i a, __m256i b, const std::int8_t* h) {
+  const __m256i sign{_mm256_sub_epi32(_mm256_cmpgt_epi32(a, b), _mm256_cmpgt_epi32(b, a))};
+  const __m256i hs{_mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(h)))};
+  const int mask{_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(sign, hs)))};
+  return static_cast<int>(std::bitset<8>(static_cast<unsigned>(mask)).count());
+}
+
+inline int rank_matches(std::int32_t a, const std::int32_t* b, const std::int8_t* h) {
+  return rank_matches(_mm256_set1_epi32(a),
+                      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)), h);
+}
+
+inline int rank_matches(const std::int32_t* a, const std::int32_t* b, const std::int8_t* h) {
+  return rank_matches(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)),
+                      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)), h);
+}
+
+/*
+ * Set bit k of gt if b[k] - a is greater than diff_threshold, and bit k of
+ * lt if it is less than -diff_threshold, for k in [0, 4).
+ */
+const int value_lanes{4};
+
+inline void value_signs(double a, const double* b, double diff_threshold,
+                        unsigned& gt, unsigned& lt) {
+  const __m256d d{_mm256_sub_pd(_mm256_loadu_pd(b), _mm256_set1_pd(a))};
+  gt = static_cast<unsigned>(
+    _mm256_movemask_pd(_mm256_cmp_pd(d, _mm256_set1_pd(diff_threshold), _CMP_GT_OQ)));
+  lt = static_cast<unsigned>(
+    _mm256_movemask_pd(_mm256_cmp_pd(d, _mm256_set1_pd(-diff_threshold), _CMP_LT_OQ)));
+}
+
+#elif defined(OPA_SIMD_NEON)
+
+/*
+ * As for AVX2 but with 4 lanes. h is read 8 bytes at a time, so sign
+ * patterns must be padded (see pack_signs()).
+ */
+inline int rank_matches(int32x4_t a, int32x4_t b, const std::int8_t* h) {
+  const int32x4_t sign{vsubq_s32(vreinterpretq_s32_u32(vcgtq_s32(a, b)),
+                                 vreinterpretq_s32_u32(vcgtq_s32(b, a)))};
+  const int32x4_t hs{vmovl_s16(vget_low_s16(vmovl_s8(vld1_s8(h))))};
+  return static_cast<int>(vaddvq_u32(vshrq_n_u32(vceqq_s32(sign, hs), 31)));
+}
+
+inline int rank_matches(std::int32_t a, const std::int32_t* b, const std::int8_t* h) {
+  return rank_matches(vdupq_n_s32(a), vld1q_s32(b), h);
+}
+
+inline int rank_matches(const std::int32_t* a, const std::int32_t* b, const std::int8_t* h) {
+  return rank_matches(vld1q_s32(a), vld1q_s32(b), h);
+}
+
+#endif
+
+} // namespace simd
+} // namespace opa
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * opa: An Implementation of Ordinal Pattern Analysis.
+ * Copyright (C) 2022 Timothy Beechey (tim.beechey@protonmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A minimal thread pool for the native c-value engines. Work items must not
+ * call the R API, since R is single threaded.
+ */
+
+#ifndef OPA_THREADS_H
+#define OPA_THREADS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "progress.h"
+
+namespace opa {
+
+/*
+ * The number of workers parallel_for() uses for n_items items.
+ */
+inline int n_workers(std::size_t n_items, int nthreads) {
+  const std::size_t requested{static_cast<std::size_t>(std::max(nthreads, 1))};
+  return static_cast<int>(std::max<std::size_t>(1, std::min(requested, n_items)));
+}
+
+/*
+ * Watches a parallel_for() call from the calling thread. The workers report
+ * their work to progress, and poll() is called on the calling thread every
+ * poll_interval_ms while they run, so it may use the R API. If poll()
+ * returns false the work is cancelled: workers claim no more items, and
+ * stop their current item at its next progress batch.
+ */
+class Monitor {
+public:
+  virtual ~Monitor() {}
+  virtual bool poll() = 0;
+  Progress progress;
+};
+
+const int poll_interval_ms{100};
+
+/*
+ * Call fn(item, worker) for every item in [0, n_items) using up to nthreads
+ * threads, where worker in [0, nthreads) identifies the calling thread so
+ * that it can use its own scratch memory. Items are claimed one at a time
+ * from a shared atomic counter, so a thread which finishes a short item
+ * immediately takes the next unclaimed one and a few long items cannot
+ * stall a static partition of the work. The calling thread is one of the
+ * workers, unless a monitor is given, in which case every worker is a new
+ * thread and the calling thread polls the monitor until they finish. The
+ * first exception thrown by any item is rethrown on the calling thread once
+ * all workers have stopped.
+ */
+template <typename F>
+void parallel_for(std::size_t n_items, int nthreads, F fn, Monitor* monitor = nullptr) {
+  const int workers{n_workers(n_items, nthreads)};
+  if (workers == 1 && !monitor) {
+    for (std::size_t item = 0; item < n_items; item++)
+      fn(item, 0);
+    return;
+  }
+
+  std::atomic<std::size_t> next{0};
+  std::atomic<bool> failed{false};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  int running{workers};
+  std::mutex running_mutex;
+  std::condition_variable finished;
+
+  auto work = [&](int worker) {
+    try {
+      for (std::size_t item = next++;
+           item < n_items && !failed && !(monitor && monitor->progress.cancelled());
+           item = next++)
+        fn(item, worker);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error)
+        error = std::current_exception();
+      failed = true;
+    }
+    std::lock_guard<std::mutex> lock(running_mutex);
+    running--;
+    finished.notify_one();
+  };
+
+  std::vector<std::thread> threads;
+  const int first_thread{monitor ? 0 : 1};
+  threads.reserve(workers - first_thread);
+  for (int worker = first_thread; worker < workers; worker++)
+    threads.emplace_back(work, worker);
+  if (monitor) {
+    std::unique_lock<std::mutex> lock(running_mutex);
+    while (!finished.wait_for(lock, std::chrono::milliseconds(poll_interval_ms),
+                              [&] { return running == 0; })) {
+      lock.unlock();
+      if (!monitor->poll())
+        monitor->progress.cancel();
+      lock.lock();
+    }
+  } else {
+    work(0);
+  }
+  for (std::size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+/*
+ * Seconds elapsed on a steady clock since start.
+ */
+inline double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * parallel_for(), also adding the time worker w spends processing items to
+ * busy[w], so that the utilization of each thread can be reported. busy must
+ * have an element for each of up to nthreads workers, and accumulates over
+ * calls. Each worker writes only its own element.
+ */
+template <typename F>
+void timed_parallel_for(std::size_t n_items, int nthreads, std::vector<double>& busy, F fn,
+                        Monitor* monitor = nullptr) {
+  parallel_for(n_items, nthreads, [&](std::size_t item, int worker) {
+    const std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+    fn(item, worker);
+    busy[worker] += seconds_since(start);
+  }, monitor);
+}
+
+} // namespace opa
+
+#endif